@@ -0,0 +1,242 @@
+/**
+ * bench_http.c
+ *
+ * HTTP load generator for monitor_server: keeps a number of persistent
+ * connections busy with pipelined GET requests for a fixed time and
+ * reports the responses per second. bench_threads.sh runs it against
+ * the server at several --threads counts.
+ *
+ * Build:  make bench/bench_http
+ * Usage:  ./bench/bench_http [--host ADDR] [--port N] [--path PATH] [--connections N]
+ *                            [--depth N] [--threads N] [--seconds N]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define MAX_DEPTH 64
+#define MAX_THREADS 64
+#define RESPONSE_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    const char *host;
+    int port;
+    const char *path;
+    int connections;
+    int depth;              // Requests in flight per connection
+    int threads;
+    int seconds;
+} BenchConfig;
+
+typedef struct {
+    int fd;
+    int outstanding;        // Requests sent and not yet answered
+    size_t len;
+    char buf[RESPONSE_BUFFER_SIZE];
+} Client;
+
+typedef struct {
+    pthread_t thread;
+    int count;              // Connections of this thread
+    unsigned long responses;
+    unsigned long errors;
+} LoadThread;
+
+static BenchConfig config;
+static char request[512];
+static size_t request_len;
+static double deadline;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server(void) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(config.port) };
+    if (fd < 0 || inet_pton(AF_INET, config.host, &addr.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/**
+ * Sends a full pipeline of requests on a connection with none in flight.
+ * @return 0 on success, -1 on error.
+ */
+static int send_pipeline(Client *c) {
+    static _Thread_local char batch[sizeof(request) * MAX_DEPTH];
+    for (int i = 0; i < config.depth; i++) memcpy(batch + i * request_len, request, request_len);
+
+    size_t len = request_len * (size_t)config.depth, sent = 0;
+    while (sent < len) {
+        ssize_t n = write(c->fd, batch + sent, len - sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    c->outstanding = config.depth;
+    return 0;
+}
+
+/**
+ * Consumes the complete responses in a connection's buffer.
+ * @return Number of responses consumed, or -1 on a malformed response.
+ */
+static int consume_responses(Client *c) {
+    int done = 0;
+    for (;;) {
+        char *end = memmem(c->buf, c->len, "\r\n\r\n", 4);
+        if (!end) return done;
+        size_t head_len = (size_t)(end + 4 - c->buf);
+
+        char *cl = memmem(c->buf, head_len, "Content-Length:", 15);
+        if (!cl) return -1;
+        size_t total = head_len + strtoul(cl + 15, NULL, 10);
+        if (total > sizeof(c->buf)) return -1;
+        if (c->len < total) return done;
+
+        memmove(c->buf, c->buf + total, c->len - total);
+        c->len -= total;
+        done++;
+    }
+}
+
+static void *load_main(void *arg) {
+    LoadThread *t = arg;
+    Client *clients = calloc((size_t)t->count, sizeof(*clients));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!clients || epoll_fd < 0) {
+        perror("load thread");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < t->count; i++) {
+        clients[i].fd = connect_server();
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &clients[i] };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+        if (send_pipeline(&clients[i]) != 0) t->errors++;
+    }
+
+    struct epoll_event events[64];
+    while (now_sec() < deadline) {
+        int n = epoll_wait(epoll_fd, events, 64, 100);
+        for (int i = 0; i < n; i++) {
+            Client *c = events[i].data.ptr;
+            ssize_t r = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+            if (r <= 0) {
+                if (r < 0 && errno == EINTR) continue;
+                t->errors++;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+                continue;
+            }
+            c->len += (size_t)r;
+
+            int done = consume_responses(c);
+            if (done < 0) {
+                t->errors++;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+                continue;
+            }
+            t->responses += (unsigned long)done;
+            c->outstanding -= done;
+            if (c->outstanding == 0 && send_pipeline(c) != 0) t->errors++;
+        }
+    }
+
+    for (int i = 0; i < t->count; i++) close(clients[i].fd);
+    close(epoll_fd);
+    free(clients);
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--host ADDR] [--port N] [--path PATH] [--connections N] [--depth N] [--threads N] [--seconds N]\n"
+        "  --host ADDR       Server IPv4 address (default 127.0.0.1)\n"
+        "  --port N          Server port (default 8080)\n"
+        "  --path PATH       Path requested (default /api/latest)\n"
+        "  --connections N   Persistent connections (default 64)\n"
+        "  --depth N         Pipelined requests in flight per connection (1-%d, default 8)\n"
+        "  --threads N       Load generator threads (1-%d, default 1)\n"
+        "  --seconds N       Duration of the run (default 5)\n",
+        prog, MAX_DEPTH, MAX_THREADS);
+}
+
+int main(int argc, char **argv) {
+    config = (BenchConfig){ "127.0.0.1", 8080, "/api/latest", 64, 8, 1, 5 };
+    for (int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!value) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--host") == 0) config.host = value;
+        else if (strcmp(argv[i], "--port") == 0) config.port = atoi(value);
+        else if (strcmp(argv[i], "--path") == 0) config.path = value;
+        else if (strcmp(argv[i], "--connections") == 0) config.connections = atoi(value);
+        else if (strcmp(argv[i], "--depth") == 0) config.depth = atoi(value);
+        else if (strcmp(argv[i], "--threads") == 0) config.threads = atoi(value);
+        else if (strcmp(argv[i], "--seconds") == 0) config.seconds = atoi(value);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (config.depth < 1 || config.depth > MAX_DEPTH || config.threads < 1 || config.threads > MAX_THREADS ||
+        config.connections < config.threads || config.seconds < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", config.path, config.host);
+    if (n < 0 || (size_t)n >= sizeof(request)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    request_len = (size_t)n;
+
+    static LoadThread threads[MAX_THREADS];
+    double start = now_sec();
+    deadline = start + config.seconds;
+    for (int i = 0; i < config.threads; i++) {
+        threads[i].count = config.connections * (i + 1) / config.threads - config.connections * i / config.threads;
+        errno = pthread_create(&threads[i].thread, NULL, load_main, &threads[i]);
+        if (errno) {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned long responses = 0, errors = 0;
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        responses += threads[i].responses;
+        errors += threads[i].errors;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("%lu responses in %.2f s: %.0f req/s (%d connections, depth %d, %lu errors)\n",
+           responses, elapsed, responses / elapsed, config.connections, config.depth, errors);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
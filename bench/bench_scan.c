@@ -0,0 +1,194 @@
+/**
+ * bench_scan.c
+ *
+ * Throughput of monitor_server's newline scanners over a multi-GB log:
+ * each implementation the CPU supports (memchr, SSE2, AVX2 or NEON)
+ * scans the same mmap'd file, and the selected one is also run the way
+ * the server reads the log, pread() into a stride-sized buffer.
+ *
+ * The log is generated on first use with sysmon-like lines of varying
+ * length around line_bytes, and kept for later runs; a different size
+ * or line length writes a new file.
+ *
+ * Build and run: make bench
+ * Usage:         ./bench/bench_scan [size_mb] [line_bytes] [dir]
+ */
+
+#define main monitor_server_main
+#include "../monitor_server.c"
+#undef main
+
+#define BENCH_DEFAULT_MB 2048
+#define BENCH_DEFAULT_LINE 500    // Average line length; a Pi 4 sample line is about this long
+#define BENCH_MIN_LINE 80
+#define BENCH_MAX_LINE 900
+#define BENCH_DEFAULT_DIR "/tmp"
+#define BENCH_CHUNK (1 << 20) // Bytes handed to one run of scan calls: offsets are 32-bit
+#define BENCH_ROUNDS 3        // Best of
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes size bytes of JSON lines averaging about line_bytes, spread
+ * over half to one and a half times that.
+ * @return 0 on success, -1 on error.
+ */
+static int generate_log(const char *path, off_t size, int line_bytes) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    static char line[1024];
+    unsigned seed = 1;
+    off_t written = 0;
+    for (long i = 0; written < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        // 62 bytes of each line are not padding
+        int pad = line_bytes / 2 - 62 + (int)((seed >> 16) % (unsigned)line_bytes);
+        if (pad < 0) pad = 0;
+        int len = snprintf(line, sizeof(line), "{\"timestamp\":%ld.5,\"cpu\":{\"usage_pct\":%u.%u},\"pad\":\"%.*s\"}\n",
+                           1700000000 + i, (seed >> 8) % 100, (seed >> 4) % 10, pad,
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                           "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+        if (fwrite(line, 1, (size_t)len, f) != (size_t)len) {
+            fclose(f);
+            return -1;
+        }
+        written += len;
+    }
+    return fclose(f);
+}
+
+/**
+ * Counts the newlines of buf[0..len) the way the server walks a buffer:
+ * a batch of line ends per call, resuming after the last one.
+ */
+static size_t count_lines(NewlineScanner scan, const char *buf, size_t len) {
+    size_t lines = 0;
+    uint32_t eols[LINE_BATCH];
+    for (size_t chunk = 0; chunk < len; chunk += BENCH_CHUNK) {
+        size_t chunk_len = (len - chunk < BENCH_CHUNK) ? len - chunk : BENCH_CHUNK;
+        size_t pos = 0, count;
+        while (pos < chunk_len && (count = scan(buf + chunk + pos, chunk_len - pos, eols, LINE_BATCH)) > 0) {
+            lines += count;
+            pos += eols[count - 1] + 1;
+        }
+    }
+    return lines;
+}
+
+/**
+ * Scans the whole mapping BENCH_ROUNDS times and prints the best rate.
+ * @return Newlines found.
+ */
+static size_t bench_mmap(const char *name, NewlineScanner scan, const char *map, size_t len) {
+    double best = 1e30;
+    size_t lines = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        double t0 = now_sec();
+        lines = count_lines(scan, map, len);
+        double t = now_sec() - t0;
+        if (t < best) best = t;
+    }
+    printf("  mmap  %-7s %7.2f GB/s  (%zu lines)\n", name, len / best / 1e9, lines);
+    return lines;
+}
+
+/**
+ * Reads the file with pread() into a stride-sized buffer, as the server
+ * does, and scans each buffer.
+ * @return Newlines found.
+ */
+static size_t bench_pread(const char *name, NewlineScanner scan, int fd, size_t len) {
+    static char buf[LOG_INDEX_STRIDE];
+    double best = 1e30;
+    size_t lines = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        double t0 = now_sec();
+        lines = 0;
+        for (off_t offset = 0; offset < (off_t)len; ) {
+            ssize_t n = pread(fd, buf, sizeof(buf), offset);
+            if (n <= 0) break;
+            lines += count_lines(scan, buf, (size_t)n);
+            offset += n;
+        }
+        double t = now_sec() - t0;
+        if (t < best) best = t;
+    }
+    printf("  pread %-7s %7.2f GB/s  (%zu lines, %d KiB reads)\n", name, len / best / 1e9, lines,
+           LOG_INDEX_STRIDE / 1024);
+    return lines;
+}
+
+int main(int argc, char **argv) {
+    long size_mb = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_MB;
+    long line_bytes = (argc > 2) ? atol(argv[2]) : BENCH_DEFAULT_LINE;
+    const char *dir = (argc > 3) ? argv[3] : BENCH_DEFAULT_DIR;
+    if (size_mb <= 0 || line_bytes < BENCH_MIN_LINE || line_bytes > BENCH_MAX_LINE) {
+        fprintf(stderr, "Usage: %s [size_mb] [line_bytes %d-%d] [dir]\n", argv[0], BENCH_MIN_LINE, BENCH_MAX_LINE);
+        return EXIT_FAILURE;
+    }
+    off_t size = (off_t)size_mb << 20;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/bench_scan-%ldM-%ld.log", dir, size_mb, line_bytes);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size < size) {
+        printf("Generating %ld MB of %ld-byte log lines in %s...\n", size_mb, line_bytes, path);
+        if (generate_log(path, size, (int)line_bytes) != 0) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    size_t len = (size_t)st.st_size;
+    const char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    madvise((void *)map, len, MADV_SEQUENTIAL);
+
+    // Fault the file in once, so every scanner sees the same warm page cache
+    volatile char sink = 0;
+    for (size_t i = 0; i < len; i += 4096) sink ^= map[i];
+    (void)sink;
+
+    printf("%s: %.2f GB, best of %d\n", path, len / 1e9, BENCH_ROUNDS);
+    size_t lines = bench_mmap("memchr", scan_newlines_scalar, map, len);
+    size_t mismatches = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) mismatches += bench_mmap("sse2", scan_newlines_sse2, map, len) != lines;
+    if (__builtin_cpu_supports("avx2")) mismatches += bench_mmap("avx2", scan_newlines_avx2, map, len) != lines;
+#elif defined(__ARM_NEON)
+    mismatches += bench_mmap("neon", scan_newlines_neon, map, len) != lines;
+#endif
+
+    init_line_scanner();
+    mismatches += bench_pread("memchr", scan_newlines_scalar, fd, len) != lines;
+    mismatches += bench_pread("picked", scan_newlines, fd, len) != lines;
+
+    munmap((void *)map, len);
+    close(fd);
+    if (mismatches) {
+        fprintf(stderr, "line counts differ between scanners\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# bench_threads.sh
+#
+# Requests per second of monitor_server at several --threads counts, fed
+# by a live sysmon log and loaded by bench_http over loopback. The load
+# generator shares the CPUs with the server; for clean numbers on a Pi,
+# run bench_http from another machine with --host.
+#
+# Usage: bench/bench_threads.sh [THREADS...]      (default: 1 2 4)
+# Environment: RUN_SECONDS (5), CONNECTIONS (64), DEPTH (8), CLIENT_THREADS (2),
+#              BENCH_PATH (/api/latest), PORT (18080)
+
+set -e
+cd "$(dirname "$0")/.."
+make -s sm monitor_server bench/bench_http
+
+[ $# -gt 0 ] || set -- 1 2 4
+RUN_SECONDS=${RUN_SECONDS:-5}
+CONNECTIONS=${CONNECTIONS:-64}
+DEPTH=${DEPTH:-8}
+CLIENT_THREADS=${CLIENT_THREADS:-2}
+BENCH_PATH=${BENCH_PATH:-/api/latest}
+PORT=${PORT:-18080}
+
+top=$(pwd)
+dir=$(mktemp -d)
+sm_pid=
+server_pid=
+trap 'kill $sm_pid $server_pid 2>/dev/null; rm -rf "$dir"' EXIT
+
+./sm --interval 1000 > "$dir/monitor.log" &
+sm_pid=$!
+sleep 1.5
+
+echo "$(nproc) CPUs, $CONNECTIONS connections, depth $DEPTH, $CLIENT_THREADS client threads, $BENCH_PATH"
+for threads in "$@"; do
+    (cd "$dir" && exec "$top/monitor_server" --port "$PORT" --threads "$threads" --stats 0) > /dev/null &
+    server_pid=$!
+    sleep 0.5
+    printf 'threads=%-3s ' "$threads"
+    ./bench/bench_http --port "$PORT" --path "$BENCH_PATH" --connections "$CONNECTIONS" \
+        --depth "$DEPTH" --threads "$CLIENT_THREADS" --seconds "$RUN_SECONDS"
+    kill "$server_pid"
+    wait "$server_pid" 2>/dev/null || true
+    server_pid=
+done
@@ -3,41 +3,299 @@
  * 
  * A lightweight, high-performance HTTP server for Raspberry Pi monitoring.
  * 
- * Parses the latest log entry and renders a visual dashboard.
+ * Takes the latest sample from sysmon's shared-memory ring when it is
+ * running with --shm, otherwise follows the log (JSON lines or binary
+ * records), and renders a visual dashboard.
+ *
+ * The log is followed like tail -F: inotify wakes the sampler thread when
+ * it changes, only the appended bytes are read, and each sample is parsed
+ * exactly once. Rotation and truncation are picked up without a restart.
+ * Records failing their length/CRC32C check (torn by a power cut) are
+ * skipped, and the follower picks up again at the next intact one.
+ * Requests only ever read the in-memory snapshot.
  * 
- * Compile: gcc -std=c11 -Wall -Wextra -O2 -o monitor_server monitor_server.c
+ * Clients are served from a non-blocking, edge-triggered epoll loop so a
+ * slow or half-open connection never stalls the others. Connections are
+ * HTTP/1.1 persistent, and pipelined requests are answered in order.
+ * 
+ * Routes: "/" serves the dashboard, "/api/latest" the newest sample as
+ * the raw sysmon JSON line, "/api/range?from=&to=" the log records
+ * between two times, "/api/rollup?res=" min/max/avg/last aggregates at
+ * 1s, 10s, 1m or 1h resolution, "/metrics" every sysmon field in the Prometheus
+ * text exposition format, and "/events" a Server-Sent Events stream
+ * that pushes every new sample to the open dashboard. A subscriber that
+ * has received nothing for --idle-timeout seconds gets a ":" comment
+ * line instead of being closed.
+ *
+ * Range queries go through a sparse timestamp -> offset index of the log
+ * that the sampler thread extends as the file grows, and the matching
+ * bytes are sent straight from the page cache with sendfile(). Lookups
+ * run on their own thread, so workers never wait on log reads. Line ends
+ * are located a 64-byte block at a time with AVX2/SSE2 (picked at runtime)
+ * or 16 bytes at a time with NEON, with a memchr fallback.
+ *
+ * Every new sample is also folded, in O(1), into fixed-size rings of
+ * rolled-up buckets per resolution (--rollup-points buckets each), so
+ * trend charts never touch the raw log.
+ *
+ * The dashboard is split at startup into static segments and per-sample
+ * value slots, and sent with scatter-gather I/O without copying the
+ * static markup.
+ *
+ * Cached responses carry an ETag and Last-Modified taken from the sample
+ * timestamp, so conditional requests get a 304 without rendering
+ * anything, and Cache-Control max-age runs until the next expected sample.
+ *
+ * Clients sending Accept-Encoding: gzip get compressed responses. The
+ * static segments are deflated once at startup and only the slot values
+ * are compressed per sample; the pieces are joined into one gzip member.
+ *
+ * With --threads N, N workers each run their own epoll loop on a
+ * SO_REUSEPORT listener, pinned to a core. All of them read the latest
+ * sample from one lock-free snapshot refreshed by the main thread.
+ * 
+ * Compile: gcc -std=c11 -Wall -Wextra -O2 -pthread -o monitor_server monitor_server.c -lrt -lz
+ * Usage:   ./monitor_server [--port N] [--idle-timeout SEC] [--threads N] [--backlog N] [--stats SEC]
+ *                          [--rollup-points N]
  */
 
 #define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 // Logs past 2 GiB on 32-bit Raspberry Pi OS
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <stdint.h>
 #include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <zlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "sysmon_record.h"
 
 // Configuration
 #define PORT 8080
 #define MONITOR_FILE "monitor.log"
-#define READ_CHUNK_SIZE 1024 // Read last 1KB to find last line
+#define READ_CHUNK_SIZE 8192 // First tail read when looking for the last line; doubled as needed
+#define FOLLOW_BUFFER_SIZE (64 * 1024) // Appended log bytes read per call, > any line or record
+#define SHM_STALE_INTERVALS 3 // Sample intervals without a new ring record before falling back to the log
+#define SHM_STALE_SLACK_MS 1000
+#define SHM_PROBE_MS 1000 // How often a stale ring is checked for having been re-created
+#define LINE_BATCH 64 // Line ends collected per scan_newlines() call
+#define LATEST_RECORD_ATTEMPTS 64 // Damaged binary records skipped looking for the newest intact one
 #define BACKLOG 10
+#define MAX_THREADS 64
+#define SAMPLE_POLL_MS 100 // How often the sampler thread looks for a new shm sample
+#define MAX_EVENTS 256
+#define DEFAULT_IDLE_TIMEOUT_SEC 30
+#define REQUEST_BUFFER_SIZE 2048
+#define SMALL_RESPONSE_SIZE 512 // Per-connection buffer for uncached (error/no data) responses
+#define MAX_PAGE_PARTS 64       // Static segments plus dynamic slots of the dashboard
+#define RESPONSE_IOV_MAX (MAX_PAGE_PARTS + 3) // Page parts plus the head, gzip header and trailer
+#define SLOT_VALUE_SIZE 32
+#define RESPONSE_HEAD_SIZE 320
+#define RAW_SAMPLE_SIZE 32768   // Largest sysmon JSON record served by /api/latest
+#define SSE_EVENT_SIZE 512
+#define DEFAULT_STATS_INTERVAL_SEC 60
+#define DEFAULT_SAMPLE_INTERVAL_MS 1000 // Assumed for logs that predate interval_ms
+#define ETAG_SIZE 32
+#define METRICS_BUFFER_SIZE (256 * 1024) // Exposition for the largest (257-slot) sample
+#define LOG_INDEX_STRIDE (64 * 1024) // Log bytes between two index entries
+#define LOG_PROBE_SIZE 1024          // First read at an index probe point, doubled until a line fits
+#define DEFAULT_ROLLUP_POINTS 1440     // Buckets kept per resolution: 24h of 1m points
+#define MAX_ROLLUP_POINTS 1000000
+#define ROLLUP_POINT_SIZE 320          // Upper bound of one rendered bucket
+#define SENDFILE_CHUNK (1024 * 1024)
+#define JSON_PATH_SIZE 64
+#define JSON_MAX_DEPTH 8
+#define JSON_NUMBER_SIZE 64     // Longest number token converted; sysmon's are far shorter
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+#define HTTP_DATE_SIZE 32
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 10    // Final empty block, CRC32 and ISIZE
+#define GZIP_SLOT_SIZE 64       // Deflated slot value, including the sync flush marker
+
+// Destination for the newest sample as a JSON line
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} RawSample;
 
 // Struct to hold parsed data
 typedef struct {
+    double timestamp;   // Sample time (seconds since the epoch)
     double uptime;
     double cpu_temp;
     double cpu_usage;
     long mem_total;
     long mem_free;
     double mem_used_pct;
+    unsigned interval_ms; // Sampling interval, i.e. when the next sample is due
 } SystemData;
 
+typedef struct {
+    int port;
+    int idle_timeout_sec;
+    int threads;
+    int backlog;
+    int stats_interval_sec; // 0 disables the periodic stats line
+    int rollup_points;      // Buckets per rollup resolution
+} ServerConfig;
+
+typedef enum {
+    CONN_READING,   // Waiting for the request headers
+    CONN_WRITING,   // Flushing the response
+    CONN_STREAMING, // Subscribed to /events, waiting for the next sample
+    CONN_LOOKUP     // Waiting for the range lookup thread to answer /api/range
+} ConnState;
+
+typedef struct {
+    char method[16];
+    char path[256];
+    size_t head_len;          // Request line and headers, including the final CRLFCRLF
+    uint64_t content_length;
+    int keep_alive;
+    int accept_gzip;
+    int head;                 // HEAD: send the headers only
+    char if_none_match[128];  // Raw header value, empty if absent
+    time_t if_modified_since; // -1 if absent or unparsable
+} HttpRequest;
+
+// Dynamic values of the page, filled once per sample generation
+typedef enum {
+    SLOT_CPU_PCT,
+    SLOT_CPU_COLOR,
+    SLOT_MEM_PCT,
+    SLOT_MEM_COLOR,
+    SLOT_TEMP,
+    SLOT_UPTIME,
+    SLOT_FREE_MB,
+    SLOT_TOTAL_MB,
+    PAGE_SLOT_COUNT
+} PageSlot;
+
+// Responses cached per sample generation
+typedef enum {
+    CACHE_DASHBOARD,
+    CACHE_DASHBOARD_GZIP,
+    CACHE_LATEST_JSON,
+    CACHE_LATEST_JSON_GZIP,
+    CACHE_METRICS,
+    CACHE_METRICS_GZIP,
+    CACHE_SSE_EVENT,
+    CACHE_COUNT
+} CacheId;
+
+/**
+ * Response for one sample generation, in both Connection variants, as an
+ * iovec list over the body (for the dashboard: the static page segments
+ * and this generation's slot values) preceded by the header. Reference counted: the worker's
+ * cache holds one reference and every connection still writing it holds
+ * another.
+ */
+typedef struct {
+    int refs;
+    uint64_t generation;
+    double timestamp;
+    unsigned interval_ms;
+    int64_t fresh_until_ms; // Wall-clock time until which the max-age in the header holds
+    void *owned_body;       // Body buffer freed with the entry, if any
+    int iovcnt;
+    struct iovec iov[2][RESPONSE_IOV_MAX]; // [0] Connection: close, [1] Connection: keep-alive
+    size_t len[2];
+    char head[2][RESPONSE_HEAD_SIZE];
+    char values[PAGE_SLOT_COUNT][SLOT_VALUE_SIZE];
+} CachedResponse;
+
+/**
+ * Per-client state. Partial reads and writes resume where they left off
+ * on the next edge-triggered event.
+ */
+typedef struct Connection {
+    int fd;
+    ConnState state;
+    int keep_alive;         // Keep the connection open after the current response
+    int peer_closed;        // Client shut down its side; finish pending responses then close
+    int head_only;          // Current request is HEAD: never queue a body
+    int streaming;          // Switch to CONN_STREAMING once the /events headers are sent
+    int closed;             // Closed, freed once the current batch of epoll events is handled
+    uint64_t event_generation; // Last sample generation pushed to a /events subscriber
+    uint64_t discard;       // Request body bytes still to skip
+    int64_t last_active_ms;
+    struct Connection *idle_prev; // Idle list, least recently active first
+    struct Connection *idle_next;
+    struct Connection *sub_prev;  // /events subscribers of the worker
+    struct Connection *sub_next;
+    struct Connection *closed_next; // Closed connections awaiting free()
+    struct RangeLookup *lookup;   // Pending /api/range lookup, while in CONN_LOOKUP
+    size_t in_len;
+    int file_fd;            // Log file streamed after out_iov (range queries), -1 if none
+    off_t file_offset;
+    off_t file_end;
+    const struct iovec *out_iov; // Either small_iov over out, or a cached response
+    int out_iovcnt;
+    size_t out_len;
+    size_t out_sent;
+    CachedResponse *out_cached;
+    struct iovec small_iov;
+    char in[REQUEST_BUFFER_SIZE];
+    char out[SMALL_RESPONSE_SIZE];
+} Connection;
+
+/**
+ * Per-worker counters, written only by the worker and summed by the main
+ * thread for the periodic stats line.
+ */
+typedef struct {
+    _Atomic unsigned long requests;
+    _Atomic unsigned long gzip_responses;
+    _Atomic unsigned long identity_responses;
+    _Atomic unsigned long gzip_bytes;     // Response bytes sent compressed
+    _Atomic unsigned long identity_bytes;
+    _Atomic unsigned long not_modified;   // 304 answers, sent without rendering
+} ServerStats;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int64_t idle_timeout_ms;
+    int connections;
+    Connection *idle_head;
+    Connection *idle_tail;
+    CachedResponse *cache[CACHE_COUNT]; // Per-worker, so no locking is needed
+    int notify_fd;              // eventfd signalled by the sampler on every new sample
+    Connection *subscribers;
+    Connection *closed;         // Closed during the current batch, see close_connection()
+    int lookup_fd;              // eventfd signalled by the range lookup thread
+    pthread_mutex_t lookup_lock;
+    struct RangeLookup *lookups_done; // Answered lookups, guarded by lookup_lock
+    ServerStats stats;
+} EventLoop;
+
 /**
  * Handles error reporting and exits.
  */
@@ -46,19 +304,273 @@ void error_die(const char *msg) {
     exit(EXIT_FAILURE);
 }
 
+/* --- Line scanning --- */
+
+/**
+ * Stores the offsets of the newlines in buf[0..len) in out, at most max of
+ * them, in order. Resume after the last one to find more.
+ * @return Number of newlines stored.
+ */
+typedef size_t (*NewlineScanner)(const char *buf, size_t len, uint32_t *out, size_t max);
+
+size_t scan_newlines_scalar(const char *buf, size_t len, uint32_t *out, size_t max) {
+    size_t n = 0;
+    for (const char *p = buf; n < max && (p = memchr(p, '\n', len - (size_t)(p - buf))); p++) {
+        out[n++] = (uint32_t)(p - buf);
+    }
+    return n;
+}
+
+// Stores the newlines flagged in a block's bit mask (shift: log2 of mask bits per byte) until out is full
+#define EMIT_NEWLINES(mask, offset, shift)                              \
+    for (; (mask) != 0 && n < max; (mask) &= (mask) - 1) {              \
+        out[n++] = (uint32_t)((offset) + (__builtin_ctzll(mask) >> (shift))); \
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+size_t scan_newlines_sse2(const char *buf, size_t len, uint32_t *out, size_t max) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t n = 0, i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), nl);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 16)), nl);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 32)), nl);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 48)), nl);
+        // Most 64-byte blocks of a log hold no newline at all
+        if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) continue;
+
+        unsigned long long mask = (unsigned long long)(unsigned)_mm_movemask_epi8(a) |
+                                  (unsigned long long)(unsigned)_mm_movemask_epi8(b) << 16 |
+                                  (unsigned long long)(unsigned)_mm_movemask_epi8(c) << 32 |
+                                  (unsigned long long)(unsigned)_mm_movemask_epi8(d) << 48;
+        EMIT_NEWLINES(mask, i, 0);
+        if (n == max) return n;
+    }
+    size_t tail = scan_newlines_scalar(buf + i, len - i, out + n, max - n);
+    for (size_t k = n; k < n + tail; k++) out[k] += (uint32_t)i;
+    return n + tail;
+}
+
+__attribute__((target("avx2")))
+size_t scan_newlines_avx2(const char *buf, size_t len, uint32_t *out, size_t max) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t n = 0, i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i)), nl);
+        __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i + 32)), nl);
+        __m256i any = _mm256_or_si256(lo, hi);
+        if (_mm256_testz_si256(any, any)) continue;
+
+        unsigned long long mask = (unsigned long long)(uint32_t)_mm256_movemask_epi8(lo) |
+                                  (unsigned long long)(uint32_t)_mm256_movemask_epi8(hi) << 32;
+        EMIT_NEWLINES(mask, i, 0);
+        if (n == max) return n;
+    }
+    size_t tail = scan_newlines_scalar(buf + i, len - i, out + n, max - n);
+    for (size_t k = n; k < n + tail; k++) out[k] += (uint32_t)i;
+    return n + tail;
+}
+#elif defined(__ARM_NEON)
+/**
+ * One 16-byte vector per step. Unlike the x86 versions there is no
+ * 64-byte block or early skip: the narrowed mask of one vector already
+ * fills a 64-bit word, and an all-zero mask costs a single test.
+ */
+size_t scan_newlines_neon(const char *buf, size_t len, uint32_t *out, size_t max) {
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    size_t n = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        // NEON has no movemask: narrowing each 0x00/0xFF byte to 4 bits gives a 64-bit mask
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)buf + i), nl);
+        unsigned long long mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        mask &= 0x1111111111111111ULL;
+        EMIT_NEWLINES(mask, i, 2);
+        if (n == max) return n;
+    }
+    size_t tail = scan_newlines_scalar(buf + i, len - i, out + n, max - n);
+    for (size_t k = n; k < n + tail; k++) out[k] += (uint32_t)i;
+    return n + tail;
+}
+#endif
+
+// Widest implementation the CPU supports, chosen by init_line_scanner()
+static NewlineScanner scan_newlines = scan_newlines_scalar;
+
+/**
+ * Picks the newline scanner: AVX2 or SSE2 on x86 (checked at runtime),
+ * NEON on ARM builds that enable it (always on 64-bit), memchr otherwise.
+ */
+void init_line_scanner(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_newlines = scan_newlines_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_newlines = scan_newlines_sse2;
+    }
+#elif defined(__ARM_NEON)
+    scan_newlines = scan_newlines_neon;
+#endif
+}
+
+/* --- JSON parsing --- */
+
+/**
+ * Receives one number found by json_walk().
+ * @param path Dotted path of the value, NUL-terminated at path_len.
+ * @param index Position in the enclosing array, -1 outside arrays.
+ * @return 0 to continue, -1 to abort the walk.
+ */
+typedef int (*JsonVisitor)(void *ctx, const char *path, size_t path_len, int index, double value);
+
+const char *json_skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+/**
+ * Converts the number at p without reading at or past end: the token is
+ * copied out first, since log slices and request buffers are not
+ * NUL-terminated where strtod() would look for the end.
+ * @return Pointer past the number, or p if there is none.
+ */
+const char *json_parse_number(const char *p, const char *end, double *value) {
+    char buf[JSON_NUMBER_SIZE];
+    size_t len = 0;
+    while (p + len < end && len < sizeof(buf) - 1 &&
+           ((p[len] >= '0' && p[len] <= '9') || p[len] == '-' || p[len] == '+' || p[len] == '.' ||
+            p[len] == 'e' || p[len] == 'E')) {
+        len++;
+    }
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    char *num_end;
+    *value = strtod(buf, &num_end);
+    return p + (num_end - buf);
+}
+
 /**
- * Simple helper to find a value in a JSON-like string.
- * Note: This is a "quick and dirty" parser for the specific known format.
+ * Skips a string starting at its opening quote.
+ * @return Pointer past the closing quote, or NULL if unterminated.
  */
-double extract_json_value(const char *json, const char *key) {
-    char search_key[64];
-    snprintf(search_key, sizeof(search_key), "\"%s\":", key);
-    
-    char *pos = strstr(json, search_key);
-    if (pos) {
-        return strtod(pos + strlen(search_key), NULL);
+const char *json_skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') p++;
+        else if (*p == '"') return p + 1;
     }
-    return 0.0;
+    return NULL;
+}
+
+/**
+ * Walks one JSON value in a single pass and hands every number in it to
+ * visit under its dotted path ("cpu.usage_pct"), with its position if it
+ * sits in an array. Strings, booleans and null are skipped.
+ * @return Pointer past the value, or NULL if malformed or visit failed.
+ */
+const char *json_walk(const char *p, const char *end, char *path, size_t path_len,
+                      int index, int depth, JsonVisitor visit, void *ctx) {
+    p = json_skip_space(p, end);
+    if (p >= end || depth > JSON_MAX_DEPTH) return NULL;
+
+    if (*p == '{' || *p == '[') {
+        int object = (*p == '{');
+        char close = object ? '}' : ']';
+        int i = 0;
+        p = json_skip_space(p + 1, end);
+        if (p < end && *p == close) return p + 1;
+
+        for (;;) {
+            size_t len = path_len;
+            if (object) {
+                if (p >= end || *p != '"') return NULL;
+                const char *key = p + 1;
+                if (!(p = json_skip_string(p, end))) return NULL;
+                size_t key_len = (size_t)(p - 1 - key);
+                if (len + key_len + 2 > JSON_PATH_SIZE) return NULL;
+                if (len > 0) path[len++] = '.';
+                memcpy(path + len, key, key_len);
+                len += key_len;
+                path[len] = '\0';
+
+                p = json_skip_space(p, end);
+                if (p >= end || *p != ':') return NULL;
+                p++;
+            }
+
+            p = json_walk(p, end, path, len, object ? index : i++, depth + 1, visit, ctx);
+            path[path_len] = '\0';
+            if (!p) return NULL;
+
+            p = json_skip_space(p, end);
+            if (p < end && *p == ',') {
+                p = json_skip_space(p + 1, end);
+                continue;
+            }
+            if (p < end && *p == close) return p + 1;
+            return NULL;
+        }
+    }
+
+    if (*p == '"') return json_skip_string(p, end);
+
+    double value;
+    const char *num_end = json_parse_number(p, end, &value);
+    if (num_end == p) {
+        // true, false or null
+        while (p < end && *p >= 'a' && *p <= 'z') p++;
+        return p;
+    }
+
+    return (visit(ctx, path, path_len, index, value) == 0) ? num_end : NULL;
+}
+
+// One wanted value of a field table, looked up by its dotted path
+typedef struct {
+    const char *path;
+    double value;
+    int present;        // 0 if the line did not contain the path
+} JsonField;
+
+typedef struct {
+    JsonField *fields;  // Sorted by path
+    size_t count;
+} JsonFieldTable;
+
+int json_field_compare(const void *key, const void *field) {
+    return strcmp(key, ((const JsonField *)field)->path);
+}
+
+/**
+ * JsonVisitor that stores the values whose path is in a JsonFieldTable.
+ * Array elements are not fields; the first occurrence of a path wins.
+ */
+int json_store_field(void *ctx, const char *path, size_t path_len, int index, double value) {
+    (void)path_len;
+    const JsonFieldTable *table = ctx;
+    if (index >= 0) return 0;
+
+    JsonField *field = bsearch(path, table->fields, table->count, sizeof(JsonField), json_field_compare);
+    if (field && !field->present) {
+        field->value = value;
+        field->present = 1;
+    }
+    return 0;
+}
+
+/**
+ * Fills a field table (sorted by path) from one JSON object in a single
+ * pass over the text, O(length + numbers * log fields). Fields the text
+ * does not contain are left with present = 0.
+ * @return 0 on success, -1 if the text is not well-formed JSON.
+ */
+int json_parse_fields(const char *json, size_t len, JsonField *fields, size_t count) {
+    for (size_t i = 0; i < count; i++) fields[i].present = 0;
+
+    JsonFieldTable table = { fields, count };
+    char path[JSON_PATH_SIZE] = "";
+    return json_walk(json, json + len, path, 0, -1, 0, json_store_field, &table) ? 0 : -1;
 }
 
 /**
@@ -72,184 +584,3177 @@ void format_uptime(double seconds, char *buffer, size_t size) {
     snprintf(buffer, size, "%02d:%02d:%02d", h, m, sec);
 }
 
+int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Read-only mapping of sysmon's shared-memory ring, NULL until sysmon publishes one
+static SysmonRing *shm_ring = NULL;
+static size_t shm_ring_len = 0;
+static dev_t shm_ring_dev;
+static ino_t shm_ring_ino;
+static uint32_t shm_ring_seq;           // write_seq when last seen to move
+static int64_t shm_ring_seq_ms;         // now_ms() at that point
+static int64_t shm_ring_probe_ms;       // Last check for a replacement of a stale ring
+static uint32_t shm_rollup_seq;         // Records of the ring folded into the rollups so far
+static uint32_t shm_published_seq;      // write_seq of the record last handed out, 0 if none
+static SysmonRecord shm_published;      // Its fixed part, for the staleness check
+
+/**
+ * Fills SystemData from a binary record (log file or shared memory).
+ */
+void record_to_system_data(const SysmonRecord *rec, SystemData *data) {
+    data->timestamp = rec->timestamp_ns / 1e9;
+    data->uptime = rec->uptime_sec;
+    data->cpu_temp = rec->temp_c;
+    data->cpu_usage = (rec->cpu_slots > 0 && rec->cpu[0] != SYSMON_PCT_NA) ? rec->cpu[0] / 10.0 : -1.0;
+    data->mem_total = (long)rec->mem_total_kb;
+    data->mem_free = (long)rec->mem_free_kb;
+    data->interval_ms = rec->interval_ms ? rec->interval_ms : DEFAULT_SAMPLE_INTERVAL_MS;
+    data->mem_used_pct = rec->mem_used_pct_x10 / 10.0;
+}
+
+/**
+ * Appends formatted text to a RawSample, marking overflow with len = size.
+ */
+void raw_append(RawSample *raw, const char *fmt, ...) {
+    if (raw->len >= raw->size) return;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(raw->buf + raw->len, raw->size - raw->len, fmt, args);
+    va_end(args);
+
+    if (n > 0) raw->len = ((size_t)n < raw->size - raw->len) ? raw->len + (size_t)n : raw->size;
+}
+
+void raw_append_pct(RawSample *raw, const char *prefix, uint16_t pct_x10) {
+    if (pct_x10 == SYSMON_PCT_NA) {
+        raw_append(raw, "%s-1.0", prefix);
+    } else {
+        raw_append(raw, "%s%u.%u", prefix, pct_x10 / 10, pct_x10 % 10);
+    }
+}
+
+/**
+ * Renders a binary record as a sysmon JSON line (same layout as sysmon's
+ * JSON output), for sources that carry no JSON of their own.
+ * @return 0 on success, -1 if the line did not fit.
+ */
+int record_to_json(const SysmonRecord *rec, RawSample *raw) {
+    raw->len = 0;
+    raw_append(raw,
+        "{\"timestamp\":%lld.%09lld,\"uptime_sec\":%.2f,\"interval_ms\":%u,\"overruns\":%llu,"
+        "\"cpu\":{\"temp_c\":%.2f,",
+        (long long)(rec->timestamp_ns / 1000000000), (long long)(rec->timestamp_ns % 1000000000),
+        rec->uptime_sec, rec->interval_ms, (unsigned long long)rec->overruns, rec->temp_c);
+
+    raw_append_pct(raw, "\"usage_pct\":", rec->cpu_slots > 0 ? rec->cpu[0] : SYSMON_PCT_NA);
+    raw_append(raw, ",\"per_core_pct\":[");
+    for (int i = 1; i < rec->cpu_slots; i++) {
+        raw_append_pct(raw, (i > 1) ? "," : "", rec->cpu[i * SYSMON_CPU_COLUMNS]);
+    }
+
+    raw_append(raw, "],\"breakdown_pct\":{");
+    for (int f = 0; f < SYSMON_CPU_COLUMNS - 1; f++) {
+        raw_append(raw, "%s\"%s\":", (f > 0) ? "," : "", sysmon_cpu_field_names[f]);
+        raw_append_pct(raw, "", rec->cpu_slots > 0 ? rec->cpu[f + 1] : SYSMON_PCT_NA);
+    }
+
+    raw_append(raw, "},\"per_core_breakdown_pct\":{");
+    for (int f = 0; f < SYSMON_CPU_COLUMNS - 1; f++) {
+        raw_append(raw, "%s\"%s\":[", (f > 0) ? "," : "", sysmon_cpu_field_names[f]);
+        for (int i = 1; i < rec->cpu_slots; i++) {
+            raw_append_pct(raw, (i > 1) ? "," : "", rec->cpu[i * SYSMON_CPU_COLUMNS + f + 1]);
+        }
+        raw_append(raw, "]");
+    }
+
+    raw_append(raw,
+        "}},\"memory\":{\"total_kb\":%llu,\"free_kb\":%llu,\"available_kb\":%llu,"
+        "\"buffers_kb\":%llu,\"cached_kb\":%llu,\"shmem_kb\":%llu,\"dirty_kb\":%llu,"
+        "\"swap_total_kb\":%llu,\"swap_free_kb\":%llu,",
+        (unsigned long long)rec->mem_total_kb, (unsigned long long)rec->mem_free_kb,
+        (unsigned long long)rec->mem_available_kb, (unsigned long long)rec->buffers_kb,
+        (unsigned long long)rec->cached_kb, (unsigned long long)rec->shmem_kb,
+        (unsigned long long)rec->dirty_kb, (unsigned long long)rec->swap_total_kb,
+        (unsigned long long)rec->swap_free_kb);
+    raw_append_pct(raw, "\"used_pct\":", rec->mem_used_pct_x10);
+    raw_append(raw, "}}\n");
+
+    return (raw->len < raw->size) ? 0 : -1;
+}
+
+void unmap_shm_ring(void) {
+    if (!shm_ring) return;
+    munmap(shm_ring, shm_ring_len);
+    shm_ring = NULL;
+}
+
 /**
- * Reads the last line of the monitor file efficiently.
+ * Maps the shared-memory ring read-only if sysmon has created it.
+ * @return 0 if the ring is mapped, -1 otherwise.
  */
-int get_latest_data(SystemData *data) {
-    int fd = open(MONITOR_FILE, O_RDONLY);
+int map_shm_ring(void) {
+    if (shm_ring) {
+        // sysmon may have re-created the ring with a different layout
+        if (sysmon_ring_size(shm_ring->capacity, shm_ring->slot_size) <= shm_ring_len &&
+            shm_ring->record_size <= SYSMON_MAX_RECORD_SIZE) {
+            return 0;
+        }
+        unmap_shm_ring();
+    }
+
+    int fd = shm_open(SYSMON_SHM_NAME, O_RDONLY, 0);
     if (fd < 0) return -1;
 
-    // Seek to end
-    off_t file_size = lseek(fd, 0, SEEK_END);
-    if (file_size == 0) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SysmonRing)) {
         close(fd);
         return -1;
     }
 
-    // Determine how much to read (last chunk or full file if small)
-    off_t seek_pos = (file_size > READ_CHUNK_SIZE) ? file_size - READ_CHUNK_SIZE : 0;
-    lseek(fd, seek_pos, SEEK_SET);
-
-    char buffer[READ_CHUNK_SIZE + 1];
-    ssize_t bytes_read = read(fd, buffer, READ_CHUNK_SIZE);
+    SysmonRing *ring = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
     close(fd);
+    if (ring == MAP_FAILED) return -1;
 
-    if (bytes_read <= 0) return -1;
-    buffer[bytes_read] = '\0';
-
-    // Find the last newline to isolate the last complete JSON object
-    // We assume the file ends with a newline. We want the line before that.
-    char *last_line = NULL;
-    char *curr = buffer;
-    char *next_line;
-    
-    // Iterate through lines in the chunk
-    while ((next_line = strchr(curr, '\n'))) {
-        if (next_line > curr) { // If not an empty line
-             // Check if this looks like our JSON start
-            if (strstr(curr, "{\"timestamp\"")) {
-                last_line = curr;
-            }
-        }
-        curr = next_line + 1;
+    if (memcmp(ring->magic, SYSMON_RING_MAGIC, SYSMON_LOG_MAGIC_LEN) != 0 ||
+        ring->version != SYSMON_RING_VERSION || ring->capacity == 0 ||
+        ring->record_size > SYSMON_MAX_RECORD_SIZE ||
+        sysmon_ring_size(ring->capacity, ring->slot_size) > (size_t)st.st_size) {
+        munmap(ring, (size_t)st.st_size);
+        return -1;
+    }
+
+    shm_ring = ring;
+    shm_ring_len = (size_t)st.st_size;
+    shm_ring_dev = st.st_dev;
+    shm_ring_ino = st.st_ino;
+    shm_ring_seq = atomic_load_explicit(&ring->write_seq, memory_order_acquire);
+    shm_ring_seq_ms = now_ms();
+    // Older records reached the rollups through the log, if at all
+    shm_rollup_seq = shm_ring_seq ? shm_ring_seq - 1 : 0;
+    shm_published_seq = 0;
+    return 0;
+}
+
+/**
+ * Whether the mapped ring has been abandoned: its write sequence has not
+ * moved, or its newest record is older, than a few sample intervals. A
+ * ring outlives a sysmon that was killed, and must not hide the live log.
+ */
+int shm_ring_stale(const SysmonRecord *newest, uint32_t seq) {
+    int64_t now = now_ms();
+    if (seq != shm_ring_seq) {
+        shm_ring_seq = seq;
+        shm_ring_seq_ms = now;
     }
-    
-    // If the buffer didn't end with \n or we are at the very end
-    if (*curr != '\0' && strstr(curr, "{\"timestamp\"")) {
-        last_line = curr;
+
+    int64_t interval_ms = newest->interval_ms ? newest->interval_ms : DEFAULT_SAMPLE_INTERVAL_MS;
+    int64_t limit_ms = SHM_STALE_INTERVALS * interval_ms + SHM_STALE_SLACK_MS;
+    int64_t age_ms = wall_ms() - newest->timestamp_ns / 1000000;
+    return now - shm_ring_seq_ms > limit_ms || age_ms > limit_ms;
+}
+
+/**
+ * Drops the mapping of a stale ring if a new one has been created under
+ * the same name since, checked at most every SHM_PROBE_MS.
+ */
+void probe_replaced_shm_ring(void) {
+    int64_t now = now_ms();
+    if (now - shm_ring_probe_ms < SHM_PROBE_MS) return;
+    shm_ring_probe_ms = now;
+
+    struct stat st;
+    int fd = shm_open(SYSMON_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_dev != shm_ring_dev || st.st_ino != shm_ring_ino) {
+        unmap_shm_ring(); // Unlinked or replaced: map afresh next time
     }
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * Takes the newest sample from the shared-memory ring without any syscalls
+ * once the ring is mapped. While write_seq has not moved since the last
+ * sample was taken, nothing is copied or formatted again.
+ * @return 0 on success, 1 if the last sample taken is still the newest,
+ *         -1 if there is no ring or it is stale.
+ */
+int get_shm_data(SystemData *data, RawSample *raw) {
+    if (map_shm_ring() != 0) return -1;
 
-    if (!last_line) return -1;
+    uint32_t seq = atomic_load_explicit(&shm_ring->write_seq, memory_order_acquire);
+    if (seq != 0 && seq == shm_published_seq) {
+        if (!shm_ring_stale(&shm_published, seq)) return 1;
+        probe_replaced_shm_ring();
+        shm_published_seq = 0;
+        return -1;
+    }
 
-    // Parse the found line
-    data->uptime = extract_json_value(last_line, "uptime_sec");
-    data->cpu_temp = extract_json_value(last_line, "temp_c");
-    data->cpu_usage = extract_json_value(last_line, "usage_pct");
-    data->mem_total = (long)extract_json_value(last_line, "total_kb");
-    data->mem_free = (long)extract_json_value(last_line, "free_kb");
-    data->mem_used_pct = extract_json_value(last_line, "used_pct");
+    union {
+        SysmonRecord record;
+        char raw[SYSMON_MAX_RECORD_SIZE];
+    } buf;
+    if (sysmon_ring_read_latest(shm_ring, buf.raw, &seq) != 0 || shm_ring_stale(&buf.record, seq)) {
+        probe_replaced_shm_ring();
+        shm_published_seq = 0;
+        return -1;
+    }
 
+    record_to_system_data(&buf.record, data);
+    if (record_to_json(&buf.record, raw) != 0) return -1;
+    shm_published_seq = seq;
+    shm_published = buf.record;
     return 0;
 }
 
 /**
- * Generates the HTML response
+ * Reads the newest intact record of a binary log.
+ * The last record is found by index arithmetic: one pread, no scanning,
+ * plus one more per damaged record in front of it.
+ * @param end Receives the end of the last complete record.
  */
-void handle_client(int client_fd) {
-    char request_buf[1024];
-    // Consume request (ignoring return value as we don't process headers)
-    if (read(client_fd, request_buf, sizeof(request_buf)) < 0) {
-        // Just continue to close if read fails
+int get_latest_binary_data(int fd, off_t file_size, const SysmonLogHeader *header,
+                           SystemData *data, RawSample *raw, off_t *end) {
+    if (header->version != SYSMON_LOG_VERSION || header->header_size < sizeof(SysmonLogHeader) ||
+        header->record_size < sizeof(SysmonRecord) || header->record_size > SYSMON_MAX_RECORD_SIZE) {
+        return -1;
     }
 
-    SystemData data = {0};
-    int ret = get_latest_data(&data);
+    // A torn trailing write leaves a partial record; round down to the last whole one
+    off_t records = (file_size - header->header_size) / header->record_size;
+    *end = header->header_size + ((records > 0) ? records : 0) * (off_t)header->record_size;
 
-    char response[4096];
-    char uptime_str[32];
-    
-    if (ret < 0) {
-        snprintf(response, sizeof(response), 
-            "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nNo data available yet.");
-        if (write(client_fd, response, strlen(response)) < 0) {
-            // Write failed
-        }
-        close(client_fd);
-        return;
+    union {
+        SysmonRecord record;
+        char raw[SYSMON_MAX_RECORD_SIZE];
+    } buf;
+    // Damaged records fail their checksum and are skipped, newest first
+    for (off_t i = records - 1; i >= 0 && i >= records - LATEST_RECORD_ATTEMPTS; i--) {
+        off_t offset = header->header_size + i * (off_t)header->record_size;
+        if (pread(fd, buf.raw, header->record_size, offset) != (ssize_t)header->record_size) return -1;
+        if (!sysmon_record_valid(&buf.record, header->record_size)) continue;
+
+        record_to_system_data(&buf.record, data);
+        return record_to_json(&buf.record, raw);
     }
+    return -1;
+}
 
-    format_uptime(data.uptime, uptime_str, sizeof(uptime_str));
+/**
+ * Parses one sample line (without its newline) and keeps a copy of it,
+ * newline included, for /api/latest.
+ * @return 0 on success, -1 if the line is not a sample or too long.
+ */
+int parse_sample_line(const char *line, size_t len, SystemData *data, RawSample *raw) {
+    static const char prefix[] = "{\"timestamp\"";
+    // A damaged record is dropped; one behind torn text is taken from where it starts
+    size_t skip = 0;
+    if (sysmon_json_verify(line, len, &skip) < 0) return -1;
+    line += skip;
+    len -= skip;
 
-    // Determine colors based on thresholds
-    // const char *cpu_color = (data.cpu_temp > 70.0) ? "#ff4444" : (data.cpu_temp > 50.0) ? "#ffbb33" : "#00C851";
-    const char *mem_color = (data.mem_used_pct > 80.0) ? "#ff4444" : "#33b5e5";
+    if (len < sizeof(prefix) - 1 || memcmp(line, prefix, sizeof(prefix) - 1) != 0) return -1;
+    if (len + 1 > raw->size) return -1;
 
-    snprintf(response, sizeof(response),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/html\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "<!DOCTYPE html>"
-        "<html><head>"
-        "<meta charset=\"UTF-8\">"
-        "<meta http-equiv=\"refresh\" content=\"1\">"
-        "<title>RPi Dashboard</title>"
-        "<style>"
-        "body { background-color: #121212; color: #e0e0e0; font-family: 'Segoe UI', sans-serif; display: flex; justify-content: center; align-items: center; height: 100vh; margin: 0; }"
-        ".dashboard { background-color: #1e1e1e; padding: 2rem; border-radius: 10px; box-shadow: 0 4px 6px rgba(0,0,0,0.3); width: 400px; }"
-        "h2 { text-align: center; margin-bottom: 1.5rem; color: #ffffff; }"
-        ".metric { margin-bottom: 1.5rem; }"
-        ".label { display: flex; justify-content: space-between; margin-bottom: 0.5rem; font-weight: bold; }"
-        ".bar-bg { background-color: #333; height: 20px; border-radius: 10px; overflow: hidden; }"
-        ".bar-fill { height: 100%%; transition: width 0.3s ease; text-align: center; font-size: 12px; line-height: 20px; color: black; font-weight: bold; }"
-        ".info-grid { display: grid; grid-template-columns: 1fr 1fr; gap: 1rem; text-align: center; margin-top: 1rem; }"
-        ".info-box { background: #2c2c2c; padding: 10px; border-radius: 5px; }"
-        ".val { font-size: 1.2rem; color: #fff; }"
-        ".unit { font-size: 0.8rem; color: #888; }"
-        "</style>"
-        "</head><body>"
-        "<div class=\"dashboard\">"
-        "  <h2>Raspberry Pi Monitor</h2>"
-        
-        "  <div class=\"metric\">"
-        "    <div class=\"label\"><span>CPU Usage</span><span>%.1f%%</span></div>"
-        "    <div class=\"bar-bg\"><div class=\"bar-fill\" style=\"width: %.1f%%; background-color: %s;\"></div></div>"
-        "  </div>"
-
-        "  <div class=\"metric\">"
-        "    <div class=\"label\"><span>Memory</span><span>%.1f%%</span></div>"
-        "    <div class=\"bar-bg\"><div class=\"bar-fill\" style=\"width: %.1f%%; background-color: %s;\"></div></div>"
-        "  </div>"
-
-        "  <div class=\"info-grid\">"
-        "    <div class=\"info-box\"><div class=\"val\">%.1f°C</div><div class=\"unit\">Temp</div></div>"
-        "    <div class=\"info-box\"><div class=\"val\">%s</div><div class=\"unit\">Uptime</div></div>"
-        "    <div class=\"info-box\"><div class=\"val\">%ld MB</div><div class=\"unit\">Free RAM</div></div>"
-        "    <div class=\"info-box\"><div class=\"val\">%ld MB</div><div class=\"unit\">Total RAM</div></div>"
-        "  </div>"
-        "</div>"
-        "</body></html>",
-        data.cpu_usage, data.cpu_usage, (data.cpu_usage > 80 ? "#ff4444" : "#00C851"),
-        data.mem_used_pct, data.mem_used_pct, mem_color,
-        data.cpu_temp,
-        uptime_str,
-        data.mem_free / 1024,
-        data.mem_total / 1024
-    );
-
-    if (write(client_fd, response, strlen(response)) < 0) {
-        // Write failed
-    }
-    close(client_fd);
-}
-
-int main(void) {
-    int server_fd, client_fd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int opt = 1;
+    // Sorted by path for json_parse_fields()
+    enum { F_TEMP, F_USAGE, F_INTERVAL, F_MEM_FREE, F_MEM_TOTAL, F_MEM_USED, F_TIMESTAMP, F_UPTIME, F_COUNT };
+    JsonField fields[F_COUNT] = {
+        [F_TEMP] = { .path = "cpu.temp_c" },
+        [F_USAGE] = { .path = "cpu.usage_pct" },
+        [F_INTERVAL] = { .path = "interval_ms" },
+        [F_MEM_FREE] = { .path = "memory.free_kb" },
+        [F_MEM_TOTAL] = { .path = "memory.total_kb" },
+        [F_MEM_USED] = { .path = "memory.used_pct" },
+        [F_TIMESTAMP] = { .path = "timestamp" },
+        [F_UPTIME] = { .path = "uptime_sec" },
+    };
+    if (json_parse_fields(line, len, fields, F_COUNT) != 0 || !fields[F_TIMESTAMP].present) return -1;
 
-    // Create socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) error_die("socket failed");
+    // Missing readings become -1, sysmon's own "unavailable"
+#define FIELD_OR(f, absent) (fields[f].present ? fields[f].value : (absent))
+    data->timestamp = fields[F_TIMESTAMP].value;
+    data->uptime = FIELD_OR(F_UPTIME, 0.0);
+    data->cpu_temp = FIELD_OR(F_TEMP, -1.0);
+    data->cpu_usage = FIELD_OR(F_USAGE, -1.0);
+    data->mem_total = (long)FIELD_OR(F_MEM_TOTAL, -1);
+    data->mem_free = (long)FIELD_OR(F_MEM_FREE, -1);
+    data->mem_used_pct = FIELD_OR(F_MEM_USED, -1.0);
+    data->interval_ms = (unsigned)FIELD_OR(F_INTERVAL, DEFAULT_SAMPLE_INTERVAL_MS);
+#undef FIELD_OR
+    if (data->interval_ms == 0) data->interval_ms = DEFAULT_SAMPLE_INTERVAL_MS;
 
-    // Force attach to port
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) error_die("setsockopt");
+    memcpy(raw->buf, line, len);
+    raw->buf[len] = '\n';
+    raw->len = len + 1;
+    return 0;
+}
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+/**
+ * Finds and parses the newest complete sample line of a JSON log, reading
+ * backwards from the end in chunks that double until the line's start is
+ * in view, so the cost follows the record size rather than the file size.
+ * A trailing line without its newline is still being written and is skipped.
+ * @param buf Scratch buffer, reused across calls; bounds the longest line.
+ * @param end Receives the end of the last complete line, where following starts.
+ */
+int get_latest_data(int fd, off_t file_size, char *buf, size_t size,
+                    SystemData *data, RawSample *raw, off_t *end) {
+    size_t have = 0;        // The window holds the file's last have bytes, at buf + size - have
+    size_t chunk = READ_CHUNK_SIZE;
+    off_t eol = -1;         // File offset of the newline ending the next line to try
 
-    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) error_die("bind failed");
-    if (listen(server_fd, BACKLOG) < 0) error_die("listen");
+    while (have < size && (off_t)have < file_size) {
+        size_t want = (size - have < chunk) ? size - have : chunk;
+        if ((off_t)want > file_size - (off_t)have) want = (size_t)(file_size - (off_t)have);
+        off_t start = file_size - (off_t)(have + want);
+        char *base = buf + size - have - want;
+        if (pread(fd, base, want, start) != (ssize_t)want) return -1;
+        have += want;
+        chunk *= 2;
+
+        if (eol < 0) {
+            // Only the bytes just read can hold the last newline
+            const char *nl = memrchr(base, '\n', want);
+            if (!nl) continue;
+            eol = start + (nl - base);
+            *end = eol + 1;
+        }
 
-    printf("Visual Monitor Server running on port %d...\n", PORT);
+        while (eol >= start) {
+            const char *line_end = base + (eol - start);
+            const char *nl = memrchr(base, '\n', (size_t)(line_end - base));
+            if (!nl && start > 0) break; // The line starts before the window: read further back
 
-    while (1) {
-        if ((client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len)) < 0) {
-            perror("accept");
-            continue;
+            const char *line = nl ? nl + 1 : base;
+            if (parse_sample_line(line, (size_t)(line_end - line), data, raw) == 0) return 0;
+            if (!nl) return -1;
+            eol = start + (nl - base);
+        }
+    }
+
+    // No newline at all: a first line still being written, or one longer than the buffer
+    if (eol < 0) *end = ((off_t)have == file_size) ? 0 : file_size;
+    return -1;
+}
+
+/* --- Shared sample snapshot --- */
+
+/**
+ * Latest sample, written by the sampler (main) thread and read by every
+ * worker. Guarded by a seqlock: seq is odd while an update is in progress.
+ */
+typedef struct {
+    _Atomic unsigned seq;
+    int available;
+    uint64_t generation;    // Bumped whenever a newer sample is published
+    SystemData data;
+    size_t raw_len;
+    char raw[RAW_SAMPLE_SIZE]; // The sample as a sysmon JSON line
+} SampleSnapshot;
+
+static SampleSnapshot latest_sample;
+
+/**
+ * Publishes a freshly read sample (single writer).
+ * @return 1 if a new generation was published, 0 if nothing changed.
+ */
+int publish_sample(const SystemData *data, const RawSample *raw, int available) {
+    unsigned seq = atomic_load_explicit(&latest_sample.seq, memory_order_relaxed);
+    if (available == latest_sample.available &&
+        (!available || data->timestamp == latest_sample.data.timestamp)) {
+        return 0; // Nothing new
+    }
+
+    atomic_store_explicit(&latest_sample.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    latest_sample.available = available;
+    if (available) {
+        latest_sample.data = *data;
+        memcpy(latest_sample.raw, raw->buf, raw->len);
+        latest_sample.raw_len = raw->len;
+    }
+    latest_sample.generation++;
+    atomic_store_explicit(&latest_sample.seq, seq + 2, memory_order_release);
+    return 1;
+}
+
+/**
+ * Copies the latest sample without taking a lock.
+ * @param generation Optional; receives the sample generation.
+ * @return 0 on success, -1 if no sample is available.
+ */
+int read_sample(SystemData *data, uint64_t *generation) {
+    for (;;) {
+        unsigned before = atomic_load_explicit(&latest_sample.seq, memory_order_acquire);
+        if (before & 1) continue;
+
+        int available = latest_sample.available;
+        uint64_t gen = latest_sample.generation;
+        *data = latest_sample.data;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&latest_sample.seq, memory_order_relaxed) != before) continue;
+
+        if (generation) *generation = gen;
+        return available ? 0 : -1;
+    }
+}
+
+/**
+ * Copies the latest sample's JSON line, and optionally its parsed fields
+ * from the same snapshot, without taking a lock. Only called when a
+ * worker's cache is stale, i.e. once per generation.
+ * @param data Optional; receives the parsed sample the line belongs to.
+ * @param generation Optional; receives the sample generation.
+ * @return Length of the line, or -1 if no sample is available.
+ */
+ssize_t read_sample_raw(char *buf, size_t size, SystemData *data, uint64_t *generation) {
+    for (;;) {
+        unsigned before = atomic_load_explicit(&latest_sample.seq, memory_order_acquire);
+        if (before & 1) continue;
+
+        int available = latest_sample.available;
+        uint64_t gen = latest_sample.generation;
+        if (data) *data = latest_sample.data;
+        size_t len = latest_sample.raw_len;
+        if (len > size) len = size;
+        memcpy(buf, latest_sample.raw, len);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&latest_sample.seq, memory_order_relaxed) != before) continue;
+
+        if (generation) *generation = gen;
+        return available ? (ssize_t)len : -1;
+    }
+}
+
+/**
+ * Current sample generation, for cheap cache validation.
+ */
+uint64_t sample_generation(void) {
+    SystemData data;
+    uint64_t generation = 0;
+    read_sample(&data, &generation);
+    return generation;
+}
+
+/* --- Log index --- */
+
+// First line at or after offset, and its sample time
+typedef struct {
+    double timestamp;
+    off_t offset;
+} LogIndexEntry;
+
+/**
+ * Sparse index of the JSON log, one entry per LOG_INDEX_STRIDE bytes.
+ * Extended by the sampler thread and searched by the range lookup thread,
+ * which copies what it needs under the read lock and reads the log
+ * without it. Binary logs need no entries: records are found by arithmetic.
+ *
+ * Lookups binary-search the entries and records, so they assume sample
+ * times never decrease along the log. That holds while the wall clock
+ * only moves forward; after it is stepped back (e.g. a first NTP sync
+ * on a Pi without an RTC) the log holds two runs of times, and a range
+ * reaching into the overlap returns the samples of only one of them.
+ */
+typedef struct {
+    pthread_rwlock_t lock;
+    dev_t dev;                  // Identity of the indexed file, to detect rotation
+    ino_t ino;
+    int binary;
+    SysmonLogHeader header;     // Binary logs only
+    LogIndexEntry *entries;
+    size_t count;
+    size_t capacity;
+    off_t end;                  // Complete lines (or records) end here
+} LogIndex;
+
+static LogIndex log_index = { .lock = PTHREAD_RWLOCK_INITIALIZER };
+
+/**
+ * Reads the timestamp a JSON log line starts with, once its checksum
+ * (if it has one) checks out.
+ * @param skip Receives the length of any torn text in front of the record.
+ * @return 0 on success, -1 if the line is not an intact sysmon sample.
+ */
+int parse_line_timestamp(const char *line, size_t len, double *timestamp, size_t *skip) {
+    *skip = 0;
+    if (sysmon_json_verify(line, len, skip) < 0) return -1;
+    line += *skip;
+    len -= *skip;
+
+    static const char prefix[] = "{\"timestamp\":";
+    if (len < sizeof(prefix) || memcmp(line, prefix, sizeof(prefix) - 1) != 0) return -1;
+
+    const char *number = line + sizeof(prefix) - 1;
+    return (json_parse_number(number, line + len, timestamp) == number) ? -1 : 0;
+}
+
+/**
+ * Finds the first complete sample line starting at or after offset whose
+ * timestamp is at least t (above t if after is set).
+ * @return 0 with *line_offset and *timestamp set, -1 if there is none before limit.
+ */
+int find_line_from(int fd, off_t offset, off_t limit, double t, int after, char *buf, size_t size,
+                   off_t *line_offset, double *timestamp) {
+    while (offset < limit) {
+        // Start one byte early: a line begins after the first newline in the buffer
+        off_t start = (offset > 0) ? offset - 1 : 0;
+        size_t want = (limit - start < (off_t)size) ? (size_t)(limit - start) : size;
+        ssize_t n = pread(fd, buf, want, start);
+        if (n <= 0) return -1;
+
+        // Line ends are found a batch at a time; only the line starts are parsed
+        size_t pos = 0;
+        int partial = (start > 0);
+        uint32_t eols[LINE_BATCH];
+        for (size_t count; (count = scan_newlines(buf + pos, (size_t)n - pos, eols, LINE_BATCH)) > 0; ) {
+            size_t base = pos;
+            for (size_t i = 0; i < count; i++) {
+                size_t eol = base + eols[i];
+                size_t skip;
+                if (!partial && parse_line_timestamp(buf + pos, eol - pos, timestamp, &skip) == 0 &&
+                    (after ? *timestamp > t : *timestamp >= t)) {
+                    *line_offset = start + (off_t)(pos + skip);
+                    return 0;
+                }
+                partial = 0;
+                pos = eol + 1;
+            }
+        }
+        if (partial) pos = (size_t)n; // No line starts in this buffer
+
+        // Continue at the incomplete line, or past it if it fills the whole buffer
+        if ((size_t)n < size) return -1;
+        off_t next = start + (off_t)pos;
+        offset = (next > offset) ? next : start + n;
+    }
+    return -1;
+}
+
+void reset_log_index(const struct stat *st) {
+    log_index.dev = st->st_dev;
+    log_index.ino = st->st_ino;
+    log_index.binary = 0;
+    log_index.count = 0;
+    log_index.end = 0;
+}
+
+/**
+ * Finds the first complete sample line at or after offset, reading a
+ * small window first and doubling it while no whole line fits, so a
+ * probe costs about one line instead of a full buffer.
+ * @return 0 with *line_offset and *timestamp set, -1 if there is none before limit.
+ */
+int probe_line(int fd, off_t offset, off_t limit, char *buf, size_t size, off_t *line_offset, double *timestamp) {
+    for (size_t window = LOG_PROBE_SIZE; ; window *= 2) {
+        off_t probe_limit = (limit - offset > (off_t)window) ? offset + (off_t)window : limit;
+        size_t probe_size = (window < size) ? window : size;
+        if (find_line_from(fd, offset, probe_limit, -1e300, 0, buf, probe_size, line_offset, timestamp) == 0) return 0;
+        if (probe_limit == limit) return -1;
+    }
+}
+
+/**
+ * Extends the index over whatever was appended to the log since the last
+ * call, probing one line per stride instead of reading the whole file.
+ * Called by the sampler thread; a rotated or truncated log is re-indexed.
+ */
+void update_log_index(void) {
+    static char buf[RAW_SAMPLE_SIZE * 2];
+
+    int fd = open(MONITOR_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+
+    pthread_rwlock_wrlock(&log_index.lock);
+    if (st.st_dev != log_index.dev || st.st_ino != log_index.ino || st.st_size < log_index.end) {
+        reset_log_index(&st);
+    }
+    if (log_index.end == 0 && !log_index.binary) {
+        // Checked until something is indexed: sysmon may not have written the header yet
+        SysmonLogHeader header;
+        if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, SYSMON_LOG_MAGIC, SYSMON_LOG_MAGIC_LEN) == 0 &&
+            header.header_size >= sizeof(header) && header.record_size >= sizeof(SysmonRecord)) {
+            log_index.binary = 1;
+            log_index.header = header;
+        }
+    }
+    pthread_rwlock_unlock(&log_index.lock);
+
+    if (st.st_size == log_index.end) {
+        close(fd);
+        return;
+    }
+
+    off_t end;
+    if (log_index.binary) {
+        const SysmonLogHeader *h = &log_index.header;
+        end = (st.st_size < h->header_size) ? 0 :
+              h->header_size + (st.st_size - h->header_size) / h->record_size * (off_t)h->record_size;
+    } else {
+        // Lines are complete up to the last newline, usually within the last line's worth of bytes
+        end = log_index.end;
+        for (size_t window = LOG_PROBE_SIZE; ; window *= 2) {
+            if (window > sizeof(buf)) window = sizeof(buf);
+            off_t tail = (st.st_size - log_index.end > (off_t)window) ? st.st_size - (off_t)window : log_index.end;
+            ssize_t n = pread(fd, buf, (size_t)(st.st_size - tail), tail);
+            const char *nl = (n > 0) ? memrchr(buf, '\n', (size_t)n) : NULL;
+            if (nl) end = tail + (nl + 1 - buf);
+            if (nl || n <= 0 || tail == log_index.end || window == sizeof(buf)) break;
+        }
+
+        // One entry per stride: only the lines at the probe points are read
+        off_t probe = log_index.count ? log_index.entries[log_index.count - 1].offset + LOG_INDEX_STRIDE : 0;
+        LogIndexEntry entry;
+        while (probe < end && probe_line(fd, probe, end, buf, sizeof(buf), &entry.offset, &entry.timestamp) == 0) {
+            pthread_rwlock_wrlock(&log_index.lock);
+            if (log_index.count == log_index.capacity) {
+                size_t capacity = log_index.capacity ? log_index.capacity * 2 : 1024;
+                LogIndexEntry *entries = realloc(log_index.entries, capacity * sizeof(*entries));
+                if (!entries) {
+                    pthread_rwlock_unlock(&log_index.lock);
+                    break;
+                }
+                log_index.entries = entries;
+                log_index.capacity = capacity;
+            }
+            log_index.entries[log_index.count++] = entry;
+            pthread_rwlock_unlock(&log_index.lock);
+            probe = entry.offset + LOG_INDEX_STRIDE;
+        }
+    }
+
+    pthread_rwlock_wrlock(&log_index.lock);
+    log_index.end = end;
+    pthread_rwlock_unlock(&log_index.lock);
+    close(fd);
+}
+
+/**
+ * Narrows the search for the first JSON line whose timestamp is at least
+ * t (or above it, if after is set) to the stretch between two index
+ * entries, by binary search over the index. from == limit means the
+ * answer is limit itself.
+ * Called with the read lock held.
+ */
+void log_index_bracket(double t, int after, off_t *from, off_t *limit) {
+    const LogIndexEntry *e = log_index.entries;
+    size_t lo = 0, hi = log_index.count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (after ? e[mid].timestamp <= t : e[mid].timestamp < t) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) {
+        *from = *limit = log_index.count ? e[0].offset : log_index.end;
+        return;
+    }
+
+    // The answer lies between entry lo-1 and entry lo
+    *from = e[lo - 1].offset;
+    *limit = (lo < log_index.count) ? e[lo].offset : log_index.end;
+}
+
+/**
+ * Offset of the first JSON line in [from, limit), as bracketed by
+ * log_index_bracket(), whose timestamp is at least t (or above it): a
+ * line scan of at most one stride.
+ * @return limit if no line in the stretch qualifies.
+ */
+off_t find_line_offset(int fd, double t, int after, off_t from, off_t limit, char *buf, size_t size) {
+    off_t offset;
+    double timestamp;
+    if (from < limit && find_line_from(fd, from, limit, t, after, buf, size, &offset, &timestamp) == 0) return offset;
+    return limit;
+}
+
+/**
+ * Offset of the first binary record before end whose timestamp is at
+ * least t (or above it).
+ */
+off_t find_record_offset(int fd, const SysmonLogHeader *h, off_t end, double t, int after) {
+    off_t lo = 0, hi = (end - h->header_size) / h->record_size;
+
+    while (lo < hi) {
+        off_t mid = lo + (hi - lo) / 2;
+        int64_t ts_ns;
+        off_t offset = h->header_size + mid * (off_t)h->record_size + (off_t)offsetof(SysmonRecord, timestamp_ns);
+        if (pread(fd, &ts_ns, sizeof(ts_ns), offset) != (ssize_t)sizeof(ts_ns)) break;
+        double ts = ts_ns / 1e9; // Compared in seconds: t may be far beyond int64 nanoseconds
+        if (after ? ts <= t : ts < t) lo = mid + 1;
+        else hi = mid;
+    }
+    return h->header_size + lo * (off_t)h->record_size;
+}
+
+/**
+ * Locates the log bytes holding the samples taken in [from, to]. Only
+ * the index lookup happens under the read lock; the log itself is read
+ * after releasing it, so the sampler never waits on these reads.
+ * @param fd Log file opened by the caller; must be the indexed file.
+ * @param header Receives the binary log header, for binary logs.
+ * @return 1 for a binary log, 0 for JSON lines, -1 if fd is not the indexed file.
+ */
+int log_index_range(int fd, double from, double to, off_t *start, off_t *end, SysmonLogHeader *header) {
+    static _Thread_local char buf[RAW_SAMPLE_SIZE * 2];
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+
+    off_t from_scan[2], to_scan[2], indexed_end = 0;
+    pthread_rwlock_rdlock(&log_index.lock);
+    int ret = -1;
+    if (st.st_dev == log_index.dev && st.st_ino == log_index.ino && log_index.end > 0) {
+        ret = log_index.binary;
+        indexed_end = log_index.end;
+        if (ret) {
+            *header = log_index.header;
+        } else {
+            log_index_bracket(from, 0, &from_scan[0], &from_scan[1]);
+            log_index_bracket(to, 1, &to_scan[0], &to_scan[1]);
+        }
+    }
+    pthread_rwlock_unlock(&log_index.lock);
+
+    if (ret < 0) return -1;
+    if (ret) {
+        *start = find_record_offset(fd, header, indexed_end, from, 0);
+        *end = find_record_offset(fd, header, indexed_end, to, 1);
+    } else {
+        *start = find_line_offset(fd, from, 0, from_scan[0], from_scan[1], buf, sizeof(buf));
+        *end = find_line_offset(fd, to, 1, to_scan[0], to_scan[1], buf, sizeof(buf));
+    }
+    if (*end < *start) *end = *start;
+    return ret;
+}
+
+/* --- Range lookups --- */
+
+/**
+ * An /api/range request handed from a worker to the lookup thread, and
+ * back with the result.
+ */
+typedef struct RangeLookup {
+    struct RangeLookup *next;
+    EventLoop *loop;        // Worker the result goes back to
+    Connection *conn;       // Set to NULL by the worker if the client goes away meanwhile
+    int fd;
+    double from;
+    double to;
+    int binary;             // log_index_range() result
+    off_t start;
+    off_t end;
+    SysmonLogHeader header;
+} RangeLookup;
+
+/**
+ * Lookups waiting for the lookup thread, in arrival order.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    RangeLookup *head;
+    RangeLookup *tail;
+} range_lookups = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL };
+
+/**
+ * Runs range lookups, whose log reads would otherwise stall a worker's
+ * event loop, and wakes the requesting worker through its eventfd.
+ */
+void *range_lookup_main(void *arg) {
+    (void)arg;
+    const uint64_t one = 1;
+    for (;;) {
+        pthread_mutex_lock(&range_lookups.lock);
+        while (!range_lookups.head) pthread_cond_wait(&range_lookups.ready, &range_lookups.lock);
+        RangeLookup *lookup = range_lookups.head;
+        range_lookups.head = lookup->next;
+        if (!range_lookups.head) range_lookups.tail = NULL;
+        pthread_mutex_unlock(&range_lookups.lock);
+
+        lookup->binary = log_index_range(lookup->fd, lookup->from, lookup->to,
+                                         &lookup->start, &lookup->end, &lookup->header);
+
+        EventLoop *loop = lookup->loop;
+        pthread_mutex_lock(&loop->lookup_lock);
+        lookup->next = loop->lookups_done;
+        loop->lookups_done = lookup;
+        pthread_mutex_unlock(&loop->lookup_lock);
+        if (write(loop->lookup_fd, &one, sizeof(one)) < 0) {
+            // Counter already pending; the worker will wake anyway
+        }
+    }
+    return NULL;
+}
+
+void start_range_lookup_thread(void) {
+    pthread_t thread;
+    errno = pthread_create(&thread, NULL, range_lookup_main, NULL);
+    if (errno) error_die("pthread_create");
+    pthread_detach(thread);
+}
+
+/**
+ * Hands a range lookup to the lookup thread; the connection waits in
+ * CONN_LOOKUP until finish_range_lookups() answers it.
+ * @return 0 on success, -1 if the lookup could not be allocated.
+ */
+int queue_range_lookup(EventLoop *loop, Connection *conn, int fd, double from, double to) {
+    RangeLookup *lookup = calloc(1, sizeof(*lookup));
+    if (!lookup) return -1;
+    lookup->loop = loop;
+    lookup->conn = conn;
+    lookup->fd = fd;
+    lookup->from = from;
+    lookup->to = to;
+    conn->lookup = lookup;
+    conn->state = CONN_LOOKUP;
+
+    pthread_mutex_lock(&range_lookups.lock);
+    if (range_lookups.tail) range_lookups.tail->next = lookup;
+    else range_lookups.head = lookup;
+    range_lookups.tail = lookup;
+    pthread_cond_signal(&range_lookups.ready);
+    pthread_mutex_unlock(&range_lookups.lock);
+    return 0;
+}
+
+/* --- Rollups --- */
+
+typedef enum {
+    ROLLUP_CPU_PCT,
+    ROLLUP_MEM_USED_PCT,
+    ROLLUP_TEMP_C,
+    ROLLUP_MEM_FREE_KB,
+    ROLLUP_METRIC_COUNT
+} RollupMetric;
+
+static const char *const rollup_metric_names[ROLLUP_METRIC_COUNT] = {
+    "cpu_pct", "mem_used_pct", "temp_c", "mem_free_kb"
+};
+static const int rollup_metric_decimals[ROLLUP_METRIC_COUNT] = { 1, 1, 1, 0 };
+
+static const int rollup_resolutions[] = { 1, 10, 60, 3600 }; // Seconds per bucket
+#define ROLLUP_RESOLUTION_COUNT (int)(sizeof(rollup_resolutions) / sizeof(rollup_resolutions[0]))
+
+// Aggregates of one metric over one bucket; floats keep a bucket small
+typedef struct {
+    double sum;         // Double: an hour of samples would swamp a float
+    uint32_t count;     // Samples with a reading, 0 if the metric was unavailable
+    float min;
+    float max;
+    float last;
+} RollupStat;
+
+typedef struct {
+    int64_t start;      // Bucket start, seconds since the epoch
+    RollupStat stat[ROLLUP_METRIC_COUNT];
+} RollupBucket;
+
+/**
+ * One ring of buckets per resolution, written by the sampler thread and
+ * read by the workers under the lock. A bucket is only taken from the
+ * ring when a sample falls into a new interval, so gaps cost nothing.
+ */
+typedef struct {
+    pthread_rwlock_t lock;
+    int capacity;               // Buckets per resolution
+    RollupBucket *buckets;      // [resolution][capacity]
+    int head[ROLLUP_RESOLUTION_COUNT];  // Newest bucket
+    int used[ROLLUP_RESOLUTION_COUNT];
+} Rollups;
+
+static Rollups rollups = { .lock = PTHREAD_RWLOCK_INITIALIZER };
+
+/**
+ * Allocates the rings: capacity buckets for each resolution.
+ */
+void init_rollups(int capacity) {
+    rollups.capacity = capacity;
+    rollups.buckets = calloc((size_t)capacity * ROLLUP_RESOLUTION_COUNT, sizeof(RollupBucket));
+    if (!rollups.buckets) error_die("calloc");
+}
+
+/**
+ * Folds one sample into the current bucket of every resolution: O(1).
+ */
+void rollup_add(const SystemData *data) {
+    float value[ROLLUP_METRIC_COUNT] = {
+        (float)data->cpu_usage, (float)data->mem_used_pct, (float)data->cpu_temp, (float)data->mem_free
+    };
+    // sysmon reports unavailable percentages and temperatures as -1
+    int present[ROLLUP_METRIC_COUNT] = { data->cpu_usage >= 0, data->mem_used_pct >= 0, data->cpu_temp >= 0, data->mem_free >= 0 };
+
+    pthread_rwlock_wrlock(&rollups.lock);
+    for (int r = 0; r < ROLLUP_RESOLUTION_COUNT; r++) {
+        RollupBucket *ring = rollups.buckets + (size_t)r * rollups.capacity;
+        int64_t start = (int64_t)data->timestamp / rollup_resolutions[r] * rollup_resolutions[r];
+
+        RollupBucket *bucket = &ring[rollups.head[r]];
+        if (rollups.used[r] == 0 || bucket->start != start) {
+            if (rollups.used[r] > 0 && start < bucket->start) continue; // Clock went back: drop
+            if (rollups.used[r] > 0) rollups.head[r] = (rollups.head[r] + 1) % rollups.capacity;
+            if (rollups.used[r] < rollups.capacity) rollups.used[r]++;
+            bucket = &ring[rollups.head[r]];
+            memset(bucket, 0, sizeof(*bucket));
+            bucket->start = start;
+        }
+
+        for (int m = 0; m < ROLLUP_METRIC_COUNT; m++) {
+            if (!present[m]) continue;
+            RollupStat *stat = &bucket->stat[m];
+            if (stat->count == 0 || value[m] < stat->min) stat->min = value[m];
+            if (stat->count == 0 || value[m] > stat->max) stat->max = value[m];
+            stat->sum += value[m];
+            stat->last = value[m];
+            stat->count++;
+        }
+    }
+    pthread_rwlock_unlock(&rollups.lock);
+}
+
+/**
+ * Folds every record published to the shm ring since the last call into
+ * the rollups (sampler thread), the way the log follower folds every new
+ * line: with an interval below SAMPLE_POLL_MS several arrive per poll.
+ * Records the writer has lapped in the meantime are lost.
+ */
+void rollup_add_ring(void) {
+    if (!shm_ring) return;
+    uint32_t head = atomic_load_explicit(&shm_ring->write_seq, memory_order_acquire);
+    if (head - shm_rollup_seq > shm_ring->capacity) shm_rollup_seq = head - shm_ring->capacity;
+
+    union {
+        SysmonRecord record;
+        char raw[SYSMON_MAX_RECORD_SIZE];
+    } buf;
+    for (; shm_rollup_seq != head; shm_rollup_seq++) {
+        if (sysmon_ring_read(shm_ring, shm_rollup_seq, buf.raw) != 0) continue;
+        SystemData data;
+        record_to_system_data(&buf.record, &data);
+        rollup_add(&data);
+    }
+}
+
+/**
+ * The i-th bucket of resolution r, oldest first. Caller holds the lock.
+ */
+const RollupBucket *rollup_bucket(int r, int i) {
+    int age = rollups.used[r] - 1 - i;
+    return &rollups.buckets[(size_t)r * rollups.capacity + (rollups.head[r] - age + rollups.capacity) % rollups.capacity];
+}
+
+/**
+ * Index of the oldest bucket of resolution r starting at or after t
+ * (after t if after is set); bucket starts only grow. Caller holds the lock.
+ */
+int rollup_lower_bound(int r, double t, int after) {
+    int lo = 0, hi = rollups.used[r];
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        double start = (double)rollup_bucket(r, mid)->start;
+        if (start < t || (after && start == t)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Renders the buckets of one resolution that start within [from, to], oldest
+ * first, as {"resolution":R,"points":[{"t":..,"cpu_pct":[min,max,avg,last],..},..]}.
+ * Unavailable metrics are null. The buffer is sized to the buckets in range,
+ * found by binary search, not to the whole ring.
+ * @return Body allocated with malloc(), or NULL if out of memory.
+ */
+char *format_rollup(int r, double from, double to, size_t *len) {
+    pthread_rwlock_rdlock(&rollups.lock);
+    int begin = rollup_lower_bound(r, from, 0);
+    int end = rollup_lower_bound(r, to, 1);
+    size_t size = (size_t)(end - begin) * ROLLUP_POINT_SIZE + 128;
+    RawSample out = { malloc(size), size, 0 };
+    if (!out.buf) {
+        pthread_rwlock_unlock(&rollups.lock);
+        return NULL;
+    }
+
+    raw_append(&out, "{\"resolution\":%d,\"fields\":[\"min\",\"max\",\"avg\",\"last\"],\"points\":[",
+               rollup_resolutions[r]);
+    for (int i = begin; i < end; i++) {
+        const RollupBucket *bucket = rollup_bucket(r, i);
+        raw_append(&out, "%s{\"t\":%lld", i > begin ? "," : "", (long long)bucket->start);
+        for (int m = 0; m < ROLLUP_METRIC_COUNT; m++) {
+            const RollupStat *stat = &bucket->stat[m];
+            if (stat->count == 0) {
+                raw_append(&out, ",\"%s\":null", rollup_metric_names[m]);
+            } else {
+                int d = rollup_metric_decimals[m];
+                raw_append(&out, ",\"%s\":[%.*f,%.*f,%.*f,%.*f]", rollup_metric_names[m],
+                           d, stat->min, d, stat->max, d, stat->sum / stat->count, d, stat->last);
+            }
+        }
+        raw_append(&out, ",\"n\":%u}", bucket->stat[ROLLUP_MEM_FREE_KB].count);
+    }
+    pthread_rwlock_unlock(&rollups.lock);
+
+    raw_append(&out, "]}\n");
+    *len = out.len;
+    return out.buf;
+}
+
+/* --- Log follower --- */
+
+/**
+ * Follows the log like tail -F. inotify says when it changed, and only the
+ * bytes appended since the last read are parsed, each sample once.
+ * Owned by the sampler thread.
+ */
+typedef struct {
+    int inotify_fd;         // -1 if inotify is unavailable: the log is then read every tick
+    int file_wd;            // Watch on the open log, -1 if none
+    int fd;                 // Open log, -1 while it does not exist
+    dev_t dev;
+    ino_t ino;
+    off_t offset;           // Next byte to read
+    int format_known;       // Whether the file has been seen to be JSON or binary
+    int binary;
+    SysmonLogHeader header;
+    int skipping;           // Dropping the rest of an overlong line
+    size_t pending_len;     // Incomplete line or record carried over to the next read
+    char buf[FOLLOW_BUFFER_SIZE];
+    int have_sample;        // data and raw hold the newest sample of the log
+    SystemData data;
+    RawSample raw;
+    char raw_buf[RAW_SAMPLE_SIZE];
+} LogFollower;
+
+static LogFollower follower = { .inotify_fd = -1, .file_wd = -1, .fd = -1 };
+
+// Set while the shm ring feeds the snapshot, so log samples do not reach the rollups twice
+static int sample_from_shm = 0;
+
+/**
+ * Records one newly appended sample of the log.
+ */
+void follower_ingest(void) {
+    follower.have_sample = 1;
+    if (!sample_from_shm) rollup_add(&follower.data);
+}
+
+/**
+ * Parses the complete lines or records in buf[0..len) and keeps the rest.
+ */
+void follower_consume(size_t len) {
+    char *buf = follower.buf;
+    size_t pos = 0;
+
+    if (!follower.format_known) {
+        // A binary log announces itself with the magic; wait until it is complete
+        size_t n = (len < SYSMON_LOG_MAGIC_LEN) ? len : SYSMON_LOG_MAGIC_LEN;
+        if (memcmp(buf, SYSMON_LOG_MAGIC, n) != 0) {
+            follower.format_known = 1;
+        } else if (len >= sizeof(SysmonLogHeader)) {
+            memcpy(&follower.header, buf, sizeof(SysmonLogHeader));
+            const SysmonLogHeader *h = &follower.header;
+            follower.binary = 1;
+            follower.format_known = 1;
+            if (h->version != SYSMON_LOG_VERSION || h->header_size < sizeof(*h) || h->header_size > len ||
+                h->record_size < sizeof(SysmonRecord) || h->record_size > SYSMON_MAX_RECORD_SIZE) {
+                follower.binary = 0; // Unreadable header: nothing will parse as a sample
+                follower.header.record_size = 0;
+            }
+            pos = h->header_size <= len ? h->header_size : len;
+        }
+    }
+
+    if (follower.format_known && follower.binary) {
+        union {
+            SysmonRecord record;
+            char raw[SYSMON_MAX_RECORD_SIZE];
+        } rec;
+        size_t size = follower.header.record_size;
+        for (; len - pos >= size; pos += size) {
+            memcpy(rec.raw, buf + pos, size);
+            if (!sysmon_record_valid(&rec.record, (uint32_t)size)) continue; // Torn or damaged: the next one is at a fixed offset
+            record_to_system_data(&rec.record, &follower.data);
+            if (record_to_json(&rec.record, &follower.raw) == 0) follower_ingest();
+        }
+    } else if (follower.format_known) {
+        uint32_t eols[LINE_BATCH];
+        for (size_t count; (count = scan_newlines(buf + pos, len - pos, eols, LINE_BATCH)) > 0; ) {
+            size_t base = pos;
+            for (size_t i = 0; i < count; i++) {
+                size_t eol = base + eols[i];
+                if (follower.skipping) {
+                    follower.skipping = 0;
+                } else if (parse_sample_line(buf + pos, eol - pos, &follower.data, &follower.raw) == 0) {
+                    follower_ingest();
+                }
+                pos = eol + 1;
+            }
+        }
+        if (pos == 0 && len == sizeof(follower.buf)) {
+            // No newline in a full buffer: not a sample line, drop it
+            follower.skipping = 1;
+            pos = len;
+        }
+    }
+
+    follower.pending_len = len - pos;
+    memmove(buf, buf + pos, follower.pending_len);
+}
+
+/**
+ * Reads and parses everything appended since the last call. A file that
+ * shrank was truncated and is read again from the start.
+ */
+void follower_read(void) {
+    struct stat st;
+    if (follower.fd < 0 || fstat(follower.fd, &st) != 0) return;
+
+    if (st.st_size < follower.offset) {
+        follower.offset = 0;
+        follower.pending_len = 0;
+        follower.format_known = 0;
+        follower.binary = 0;
+        follower.skipping = 0;
+    }
+
+    while (follower.offset < st.st_size) {
+        ssize_t n = pread(follower.fd, follower.buf + follower.pending_len,
+                          sizeof(follower.buf) - follower.pending_len, follower.offset);
+        if (n <= 0) break;
+        follower.offset += n;
+        follower_consume(follower.pending_len + (size_t)n);
+    }
+}
+
+/**
+ * Opens the log by name and starts following it at its newest sample.
+ */
+void follower_open(void) {
+    int fd = open(MONITOR_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+    follower.fd = fd;
+    follower.dev = st.st_dev;
+    follower.ino = st.st_ino;
+    follower.offset = 0;
+    follower.pending_len = 0;
+    follower.format_known = 0;
+    follower.binary = 0;
+    follower.skipping = 0;
+
+    // Binary logs start with a header describing the fixed record size
+    SysmonLogHeader header;
+    if (st.st_size >= (off_t)sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        memcmp(header.magic, SYSMON_LOG_MAGIC, SYSMON_LOG_MAGIC_LEN) == 0) {
+        follower.format_known = 1;
+        follower.binary = 1;
+        follower.header = header;
+        if (get_latest_binary_data(fd, st.st_size, &header, &follower.data, &follower.raw, &follower.offset) == 0) {
+            follower_ingest();
+        }
+    } else if (st.st_size > 0) {
+        follower.format_known = 1;
+        if (get_latest_data(fd, st.st_size, follower.buf, sizeof(follower.buf),
+                            &follower.data, &follower.raw, &follower.offset) == 0) {
+            follower_ingest();
+        }
+    }
+
+    if (follower.inotify_fd >= 0) {
+        follower.file_wd = inotify_add_watch(follower.inotify_fd, MONITOR_FILE,
+                                             IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+    follower_read(); // Anything appended since the fstat
+}
+
+/**
+ * Finishes reading the current file and stops following it.
+ */
+void follower_close(void) {
+    if (follower.fd < 0) return;
+    follower_read();
+    if (follower.file_wd >= 0) inotify_rm_watch(follower.inotify_fd, follower.file_wd);
+    follower.file_wd = -1;
+    close(follower.fd);
+    follower.fd = -1;
+}
+
+/**
+ * Sets up the inotify watches (the log's directory, for re-creation, and
+ * the log itself) and reads the newest sample.
+ */
+void follower_init(void) {
+    follower.raw = (RawSample){ follower.raw_buf, sizeof(follower.raw_buf), 0 };
+    follower.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follower.inotify_fd >= 0 &&
+        inotify_add_watch(follower.inotify_fd, ".", IN_CREATE | IN_MOVED_TO) < 0) {
+        close(follower.inotify_fd);
+        follower.inotify_fd = -1;
+    }
+    if (follower.inotify_fd < 0) perror("inotify; polling the log instead");
+    follower_open();
+}
+
+/**
+ * Whether MONITOR_FILE now names a different file than the one being followed.
+ */
+int follower_replaced(void) {
+    struct stat st;
+    if (stat(MONITOR_FILE, &st) != 0) return 0; // Gone: keep reading the old file until a new one appears
+    return follower.fd < 0 || st.st_dev != follower.dev || st.st_ino != follower.ino;
+}
+
+/**
+ * Handles pending inotify events (or, without inotify, just looks):
+ * reads appended data and switches to a rotated or re-created log.
+ * @return 1 if the log may have changed.
+ */
+int follow_log(void) {
+    int changed = 0, check_name = 0;
+
+    if (follower.inotify_fd < 0) {
+        changed = check_name = 1;
+    } else {
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n;
+        while ((n = read(follower.inotify_fd, events, sizeof(events))) > 0) {
+            const struct inotify_event *ev;
+            for (char *p = events; p < events + n; p += sizeof(*ev) + ev->len) {
+                ev = (const struct inotify_event *)p;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    changed = check_name = 1;
+                } else if (ev->wd == follower.file_wd) {
+                    if (ev->mask & IN_MODIFY) changed = 1;
+                    if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) changed = check_name = 1;
+                } else if (ev->len > 0 && strcmp(ev->name, MONITOR_FILE) == 0) {
+                    changed = check_name = 1; // Created or moved into place
+                }
+            }
+        }
+    }
+
+    if (changed) follower_read();
+    if (check_name && follower_replaced()) {
+        follower_close();
+        follower_open();
+    }
+    return changed;
+}
+
+/**
+ * Publishes the newest sample for the workers: from shared memory when
+ * sysmon runs with --shm and keeps the ring moving, otherwise the newest
+ * sample of the followed log.
+ * @return 1 if a new sample generation was published.
+ */
+int refresh_sample(void) {
+    static char raw_buf[RAW_SAMPLE_SIZE];
+    RawSample raw = { raw_buf, sizeof(raw_buf), 0 };
+    SystemData data = {0};
+
+    int shm = get_shm_data(&data, &raw);
+    sample_from_shm = (shm >= 0);
+    if (shm > 0) return 0; // The ring has not moved: the published sample is current
+    if (shm == 0) return publish_sample(&data, &raw, 1);
+    return publish_sample(&follower.data, &follower.raw, follower.have_sample);
+}
+
+/* --- Dashboard page --- */
+
+static const char *const page_slot_names[PAGE_SLOT_COUNT] = {
+    "cpu_pct", "cpu_color", "mem_pct", "mem_color", "temp", "uptime", "free_mb", "total_mb"
+};
+
+/**
+ * Dashboard markup. {{name}} marks a dynamic slot; everything else is
+ * sent straight from this array without ever being copied.
+ */
+static const char page_template[] =
+    "<!DOCTYPE html>"
+    "<html><head>"
+    "<meta charset=\"UTF-8\">"
+    "<noscript><meta http-equiv=\"refresh\" content=\"1\"></noscript>"
+    "<title>RPi Dashboard</title>"
+    "<style>"
+    "body { background-color: #121212; color: #e0e0e0; font-family: 'Segoe UI', sans-serif; display: flex; justify-content: center; align-items: center; height: 100vh; margin: 0; }"
+    ".dashboard { background-color: #1e1e1e; padding: 2rem; border-radius: 10px; box-shadow: 0 4px 6px rgba(0,0,0,0.3); width: 400px; }"
+    "h2 { text-align: center; margin-bottom: 1.5rem; color: #ffffff; }"
+    ".metric { margin-bottom: 1.5rem; }"
+    ".label { display: flex; justify-content: space-between; margin-bottom: 0.5rem; font-weight: bold; }"
+    ".bar-bg { background-color: #333; height: 20px; border-radius: 10px; overflow: hidden; }"
+    ".bar-fill { height: 100%; transition: width 0.3s ease; text-align: center; font-size: 12px; line-height: 20px; color: black; font-weight: bold; }"
+    ".info-grid { display: grid; grid-template-columns: 1fr 1fr; gap: 1rem; text-align: center; margin-top: 1rem; }"
+    ".info-box { background: #2c2c2c; padding: 10px; border-radius: 5px; }"
+    ".val { font-size: 1.2rem; color: #fff; }"
+    ".unit { font-size: 0.8rem; color: #888; }"
+    "</style>"
+    "</head><body>"
+    "<div class=\"dashboard\">"
+    "  <h2>Raspberry Pi Monitor</h2>"
+
+    "  <div class=\"metric\">"
+    "    <div class=\"label\"><span>CPU Usage</span><span><span data-slot=\"cpu_pct\">{{cpu_pct}}</span>%</span></div>"
+    "    <div class=\"bar-bg\"><div id=\"cpu-bar\" class=\"bar-fill\" style=\"width: {{cpu_pct}}%; background-color: {{cpu_color}};\"></div></div>"
+    "  </div>"
+
+    "  <div class=\"metric\">"
+    "    <div class=\"label\"><span>Memory</span><span><span data-slot=\"mem_pct\">{{mem_pct}}</span>%</span></div>"
+    "    <div class=\"bar-bg\"><div id=\"mem-bar\" class=\"bar-fill\" style=\"width: {{mem_pct}}%; background-color: {{mem_color}};\"></div></div>"
+    "  </div>"
+
+    "  <div class=\"info-grid\">"
+    "    <div class=\"info-box\"><div class=\"val\"><span data-slot=\"temp\">{{temp}}</span>°C</div><div class=\"unit\">Temp</div></div>"
+    "    <div class=\"info-box\"><div class=\"val\" data-slot=\"uptime\">{{uptime}}</div><div class=\"unit\">Uptime</div></div>"
+    "    <div class=\"info-box\"><div class=\"val\"><span data-slot=\"free_mb\">{{free_mb}}</span> MB</div><div class=\"unit\">Free RAM</div></div>"
+    "    <div class=\"info-box\"><div class=\"val\"><span data-slot=\"total_mb\">{{total_mb}}</span> MB</div><div class=\"unit\">Total RAM</div></div>"
+    "  </div>"
+    "</div>"
+    // Live updates: each /events message carries the slot values of a new sample
+    "<script>"
+    "function bar(id, pct, color) { var b = document.getElementById(id); b.style.width = pct + '%'; b.style.backgroundColor = color; }"
+    "new EventSource('/events').onmessage = function (e) {"
+    " var d = JSON.parse(e.data);"
+    " document.querySelectorAll('[data-slot]').forEach(function (el) { el.textContent = d[el.dataset.slot]; });"
+    " bar('cpu-bar', d.cpu_pct, d.cpu_color); bar('mem-bar', d.mem_pct, d.mem_color);"
+    "};"
+    "</script>"
+    "</body></html>";
+
+// A static run of the template, or a reference to a dynamic slot (slot >= 0)
+typedef struct {
+    const char *text;
+    size_t len;
+    int slot;
+    unsigned char *gz;  // Static runs only: deflated, byte-aligned and non-final
+    size_t gz_len;
+    uLong crc;          // CRC32 of text
+} PagePart;
+
+static PagePart page_parts[MAX_PAGE_PARTS];
+static int page_part_count = 0;
+
+/**
+ * Splits page_template into static segments and slot references.
+ * Called once at startup.
+ */
+void compile_page_template(void) {
+    const char *p = page_template;
+    const char *end = page_template + sizeof(page_template) - 1;
+
+    while (p < end) {
+        if (page_part_count + 2 > MAX_PAGE_PARTS) error_die("page template has too many parts");
+
+        const char *open = strstr(p, "{{");
+        const char *stop = open ? open : end;
+        if (stop > p) {
+            page_parts[page_part_count++] = (PagePart){ .text = p, .len = (size_t)(stop - p), .slot = -1 };
+        }
+        if (!open) break;
+
+        const char *name = open + 2;
+        const char *close = strstr(name, "}}");
+        if (!close) error_die("unterminated page slot");
+
+        int slot = -1;
+        for (int i = 0; i < PAGE_SLOT_COUNT; i++) {
+            if (strlen(page_slot_names[i]) == (size_t)(close - name) &&
+                strncmp(page_slot_names[i], name, (size_t)(close - name)) == 0) {
+                slot = i;
+            }
+        }
+        if (slot < 0) error_die("unknown page slot");
+
+        page_parts[page_part_count++] = (PagePart){ .slot = slot };
+        p = close + 2;
+    }
+}
+
+/**
+ * Deflates one independent piece of a gzip member: a raw deflate stream
+ * ended with a sync flush, so pieces can be concatenated in any order.
+ * @return Compressed length, or 0 if out did not have room.
+ */
+size_t deflate_piece(z_stream *zs, const void *in, size_t len, unsigned char *out, size_t out_size) {
+    if (deflateReset(zs) != Z_OK) return 0;
+    zs->next_in = (Bytef *)in;
+    zs->avail_in = (uInt)len;
+    zs->next_out = out;
+    zs->avail_out = (uInt)out_size;
+    if (deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in != 0 || zs->avail_out == 0) return 0;
+    return out_size - zs->avail_out;
+}
+
+/**
+ * Deflates every static segment of the page once. Called at startup,
+ * after compile_page_template().
+ */
+void compress_page_template(void) {
+    z_stream zs = {0};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        error_die("deflateInit2");
+    }
+
+    for (int i = 0; i < page_part_count; i++) {
+        PagePart *part = &page_parts[i];
+        if (part->slot >= 0) continue;
+
+        size_t size = deflateBound(&zs, part->len) + 16;
+        if (!(part->gz = malloc(size))) error_die("malloc");
+        if (!(part->gz_len = deflate_piece(&zs, part->text, part->len, part->gz, size))) error_die("deflate");
+        part->crc = crc32(0L, (const Bytef *)part->text, (uInt)part->len);
+    }
+    deflateEnd(&zs);
+}
+
+/**
+ * Writes the gzip member header (RFC 1952): no name, no mtime, Unix.
+ */
+void write_gzip_header(unsigned char *out) {
+    static const unsigned char header[GZIP_HEADER_SIZE] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    memcpy(out, header, GZIP_HEADER_SIZE);
+}
+
+/**
+ * Writes an empty final block followed by the CRC32 and size of the body.
+ */
+void write_gzip_trailer(unsigned char *out, uLong crc, size_t len) {
+    out[0] = 0x03; // BFINAL, fixed Huffman, end of block
+    out[1] = 0x00;
+    for (int i = 0; i < 4; i++) {
+        out[2 + i] = (unsigned char)(crc >> (8 * i));
+        out[6 + i] = (unsigned char)((uint32_t)len >> (8 * i));
+    }
+}
+
+/**
+ * Formats the dynamic values of the dashboard for one sample.
+ */
+void render_page_slots(const SystemData *data, char values[][SLOT_VALUE_SIZE], size_t lens[]) {
+    char uptime_str[32];
+    format_uptime(data->uptime, uptime_str, sizeof(uptime_str));
+
+    // Determine colors based on thresholds
+    // const char *cpu_color = (data->cpu_temp > 70.0) ? "#ff4444" : (data->cpu_temp > 50.0) ? "#ffbb33" : "#00C851";
+    const char *mem_color = (data->mem_used_pct > 80.0) ? "#ff4444" : "#33b5e5";
+
+    int n[PAGE_SLOT_COUNT];
+    n[SLOT_CPU_PCT]   = snprintf(values[SLOT_CPU_PCT], SLOT_VALUE_SIZE, "%.1f", data->cpu_usage);
+    n[SLOT_CPU_COLOR] = snprintf(values[SLOT_CPU_COLOR], SLOT_VALUE_SIZE, "%s", data->cpu_usage > 80 ? "#ff4444" : "#00C851");
+    n[SLOT_MEM_PCT]   = snprintf(values[SLOT_MEM_PCT], SLOT_VALUE_SIZE, "%.1f", data->mem_used_pct);
+    n[SLOT_MEM_COLOR] = snprintf(values[SLOT_MEM_COLOR], SLOT_VALUE_SIZE, "%s", mem_color);
+    n[SLOT_TEMP]      = snprintf(values[SLOT_TEMP], SLOT_VALUE_SIZE, "%.1f", data->cpu_temp);
+    n[SLOT_UPTIME]    = snprintf(values[SLOT_UPTIME], SLOT_VALUE_SIZE, "%s", uptime_str);
+    n[SLOT_FREE_MB]   = snprintf(values[SLOT_FREE_MB], SLOT_VALUE_SIZE, "%ld", data->mem_free / 1024);
+    n[SLOT_TOTAL_MB]  = snprintf(values[SLOT_TOTAL_MB], SLOT_VALUE_SIZE, "%ld", data->mem_total / 1024);
+
+    for (int i = 0; i < PAGE_SLOT_COUNT; i++) {
+        lens[i] = (n[i] < 0) ? 0 : ((size_t)n[i] < SLOT_VALUE_SIZE ? (size_t)n[i] : SLOT_VALUE_SIZE - 1);
+    }
+}
+
+/* --- Event loop --- */
+
+/**
+ * Moves a connection to the tail of the idle list (most recently active).
+ */
+void touch_connection(EventLoop *loop, Connection *conn) {
+    conn->last_active_ms = now_ms();
+    if (loop->idle_tail == conn) return;
+
+    // Unlink
+    if (conn->idle_prev) conn->idle_prev->idle_next = conn->idle_next;
+    if (conn->idle_next) conn->idle_next->idle_prev = conn->idle_prev;
+    if (loop->idle_head == conn) loop->idle_head = conn->idle_next;
+
+    // Append
+    conn->idle_prev = loop->idle_tail;
+    conn->idle_next = NULL;
+    if (loop->idle_tail) loop->idle_tail->idle_next = conn;
+    loop->idle_tail = conn;
+    if (!loop->idle_head) loop->idle_head = conn;
+}
+
+void add_subscriber(EventLoop *loop, Connection *conn) {
+    conn->sub_prev = NULL;
+    conn->sub_next = loop->subscribers;
+    if (loop->subscribers) loop->subscribers->sub_prev = conn;
+    loop->subscribers = conn;
+}
+
+void remove_subscriber(EventLoop *loop, Connection *conn) {
+    if (conn->sub_prev) conn->sub_prev->sub_next = conn->sub_next;
+    if (conn->sub_next) conn->sub_next->sub_prev = conn->sub_prev;
+    if (loop->subscribers == conn) loop->subscribers = conn->sub_next;
+    conn->sub_prev = conn->sub_next = NULL;
+}
+
+/**
+ * Drops one reference to a cached response, freeing it with the last one.
+ */
+void release_cached_response(CachedResponse *cached) {
+    if (cached && --cached->refs == 0) {
+        free(cached->owned_body);
+        free(cached);
+    }
+}
+
+/**
+ * Closes a connection. The memory is only released by free_closed_connections(),
+ * since events later in the same epoll batch, or the subscriber list being
+ * walked, may still point at it.
+ */
+void close_connection(EventLoop *loop, Connection *conn) {
+    if (conn->closed) return;
+    conn->closed = 1;
+    release_cached_response(conn->out_cached);
+    conn->out_cached = NULL;
+    if (conn->streaming) remove_subscriber(loop, conn);
+    if (conn->lookup) conn->lookup->conn = NULL; // finish_range_lookups() drops it
+    if (conn->file_fd >= 0) close(conn->file_fd);
+
+    if (conn->idle_prev) conn->idle_prev->idle_next = conn->idle_next;
+    if (conn->idle_next) conn->idle_next->idle_prev = conn->idle_prev;
+    if (loop->idle_head == conn) loop->idle_head = conn->idle_next;
+    if (loop->idle_tail == conn) loop->idle_tail = conn->idle_prev;
+
+    // close() also removes the fd from the epoll set
+    close(conn->fd);
+    conn->closed_next = loop->closed;
+    loop->closed = conn;
+    loop->connections--;
+}
+
+void free_closed_connections(EventLoop *loop) {
+    while (loop->closed) {
+        Connection *conn = loop->closed;
+        loop->closed = conn->closed_next;
+        free(conn);
+    }
+}
+
+/**
+ * Case-insensitive search for a token inside a (non NUL-terminated) header value.
+ */
+int has_token(const char *value, size_t len, const char *token) {
+    size_t token_len = strlen(token);
+    for (size_t i = 0; i + token_len <= len; i++) {
+        if (strncasecmp(value + i, token, token_len) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT").
+ * @return Seconds since the epoch, or -1 if malformed.
+ */
+time_t parse_http_date(const char *value, size_t len) {
+    char buf[HTTP_DATE_SIZE];
+    if (len >= sizeof(buf)) return -1;
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+
+    struct tm tm = {0};
+    const char *end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') return -1;
+    return timegm(&tm);
+}
+
+void format_http_date(time_t t, char *buf, size_t size) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/**
+ * Strong validator of one representation of a sample: the sample time in
+ * milliseconds, with a suffix for the gzip encoding.
+ */
+void format_etag(double timestamp, int gzip, char *buf, size_t size) {
+    snprintf(buf, size, "\"%lld%s\"", (long long)(timestamp * 1000.0 + 0.5), gzip ? "-gz" : "");
+}
+
+/**
+ * Seconds a client may reuse the sample: the time left until the next one
+ * is due, rounded down.
+ * @param fresh_until_ms Optional; receives the wall-clock time at which
+ *                       the returned value becomes too long.
+ */
+int sample_max_age(const SystemData *data, int64_t now, int64_t *fresh_until_ms) {
+    int64_t next_ms = (int64_t)(data->timestamp * 1000.0) + data->interval_ms;
+    int64_t left_ms = next_ms - now;
+    if (left_ms < 1000) {
+        // Due within a second, or late: no reuse until it arrives
+        if (fresh_until_ms) *fresh_until_ms = INT64_MAX;
+        return 0;
+    }
+    int max_age = (int)(left_ms / 1000);
+    if (fresh_until_ms) *fresh_until_ms = next_ms - (int64_t)max_age * 1000;
+    return max_age;
+}
+
+/**
+ * Evaluates If-None-Match, or failing that If-Modified-Since, against the
+ * current sample.
+ * @return 1 if the client's copy is current and a 304 can be sent.
+ */
+int not_modified(const HttpRequest *req, const SystemData *data, const char *etag) {
+    if (req->if_none_match[0]) {
+        if (strcmp(req->if_none_match, "*") == 0) return 1;
+
+        // Weak comparison over the comma-separated list
+        size_t etag_len = strlen(etag);
+        for (const char *p = req->if_none_match; (p = strstr(p, etag)); p += etag_len) {
+            if (p == req->if_none_match || p[-1] == ' ' || p[-1] == ',' || p[-1] == '/') return 1;
+        }
+        return 0;
+    }
+    return req->if_modified_since >= 0 && (time_t)data->timestamp <= req->if_modified_since;
+}
+
+/**
+ * Checks whether an Accept-Encoding value allows gzip: listed explicitly
+ * (or through "*") without q=0.
+ */
+int accepts_gzip(const char *value, size_t len) {
+    int gzip = -1, any = -1;
+    const char *end = value + len;
+
+    while (value < end) {
+        const char *comma = memchr(value, ',', (size_t)(end - value));
+        const char *item_end = comma ? comma : end;
+        while (value < item_end && (*value == ' ' || *value == '\t')) value++;
+
+        size_t token_len = 0;
+        while (value + token_len < item_end && value[token_len] != ';' &&
+               value[token_len] != ' ' && value[token_len] != '\t') {
+            token_len++;
+        }
+
+        // q=0, q=0.0, ... refuses the coding; any other weight accepts it
+        int accepted = 1;
+        const char *q = memchr(value, ';', (size_t)(item_end - value));
+        while (q && q < item_end) {
+            q++;
+            while (q < item_end && (*q == ' ' || *q == '\t')) q++;
+            if (item_end - q >= 2 && (q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+                const char *w = q + 2;
+                accepted = 0;
+                while (w < item_end && (*w == '0' || *w == '.')) w++;
+                if (w < item_end && *w >= '1' && *w <= '9') accepted = 1;
+            }
+            q = memchr(q, ';', (size_t)(item_end - q));
+        }
+
+        if ((token_len == 4 && strncasecmp(value, "gzip", 4) == 0) ||
+            (token_len == 6 && strncasecmp(value, "x-gzip", 6) == 0)) {
+            gzip = accepted;
+        } else if (token_len == 1 && *value == '*') {
+            any = accepted;
+        }
+        value = comma ? comma + 1 : end;
+    }
+    return gzip >= 0 ? gzip : any > 0;
+}
+
+/**
+ * Parses one HTTP/1.x request head at the start of buf.
+ * @return 1 if a complete head was parsed, 0 if more bytes are needed, -1 if malformed.
+ */
+int parse_request(const char *buf, size_t len, HttpRequest *req) {
+    const char *end = memmem(buf, len, "\r\n\r\n", 4);
+    if (!end) return 0;
+
+    memset(req, 0, sizeof(*req));
+    req->head_len = (size_t)(end - buf) + 4;
+    req->if_modified_since = -1;
+
+    // Request line: METHOD SP PATH SP HTTP/1.x
+    const char *eol = memmem(buf, req->head_len, "\r\n", 2);
+    const char *sp1 = memchr(buf, ' ', (size_t)(eol - buf));
+    if (!sp1) return -1;
+    const char *sp2 = memchr(sp1 + 1, ' ', (size_t)(eol - sp1 - 1));
+    if (!sp2) return -1;
+
+    size_t method_len = (size_t)(sp1 - buf);
+    size_t path_len = (size_t)(sp2 - sp1 - 1);
+    if (method_len == 0 || method_len >= sizeof(req->method) || path_len == 0 || path_len >= sizeof(req->path)) {
+        return -1;
+    }
+    memcpy(req->method, buf, method_len);
+    memcpy(req->path, sp1 + 1, path_len);
+    req->head = (strcmp(req->method, "HEAD") == 0);
+
+    const char *version = sp2 + 1;
+    if ((size_t)(eol - version) != 8 || strncmp(version, "HTTP/1.", 7) != 0) return -1;
+    int http11 = (version[7] == '1');
+    req->keep_alive = http11; // HTTP/1.1 defaults to persistent connections
+
+    // Header lines
+    for (const char *line = eol + 2; line < end; line = eol + 2) {
+        eol = memmem(line, (size_t)(end + 2 - line), "\r\n", 2);
+        const char *colon = memchr(line, ':', (size_t)(eol - line));
+        if (!colon) return -1;
+
+        size_t name_len = (size_t)(colon - line);
+        const char *value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) value++;
+        size_t value_len = (size_t)(eol - value);
+
+        if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+            char *num_end;
+            errno = 0;
+            unsigned long long cl = strtoull(value, &num_end, 10);
+            if (errno || num_end == value || num_end != eol) return -1;
+            req->content_length = (uint64_t)cl;
+        } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+            return -1; // Request bodies are never expected, chunked ones are refused
+        } else if (name_len == 15 && strncasecmp(line, "Accept-Encoding", 15) == 0) {
+            req->accept_gzip = accepts_gzip(value, value_len);
+        } else if (name_len == 13 && strncasecmp(line, "If-None-Match", 13) == 0) {
+            // Too long to hold: treat as absent, the client just gets a full response
+            if (value_len < sizeof(req->if_none_match)) memcpy(req->if_none_match, value, value_len);
+        } else if (name_len == 17 && strncasecmp(line, "If-Modified-Since", 17) == 0) {
+            req->if_modified_since = parse_http_date(value, value_len);
+        } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+            if (has_token(value, value_len, "close")) {
+                req->keep_alive = 0;
+            } else if (!http11 && has_token(value, value_len, "keep-alive")) {
+                req->keep_alive = 1;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Writes a complete response (headers and body) into conn->out.
+ */
+void set_response(Connection *conn, const char *status, const char *content_type,
+                  const char *body, size_t body_len) {
+    int len = snprintf(conn->out, sizeof(conn->out),
+        "HTTP/1.1 %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        status, content_type, body_len, conn->keep_alive ? "keep-alive" : "close");
+
+    size_t head_len = (len < 0) ? 0 : (size_t)len;
+    if (conn->head_only) {
+        body_len = 0; // Content-Length above still describes the GET response
+    } else if (head_len + body_len > sizeof(conn->out)) {
+        // Never send a Content-Length we cannot honour
+        body_len = 0;
+        conn->keep_alive = 0;
+    }
+    memcpy(conn->out + head_len, body, body_len);
+    conn->small_iov.iov_base = conn->out;
+    conn->small_iov.iov_len = head_len + body_len;
+    conn->out_iov = &conn->small_iov;
+    conn->out_iovcnt = 1;
+    conn->out_len = head_len + body_len;
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+}
+
+/**
+ * Completes a cache entry whose body iovecs are already in iov[0][1..body_cnt]:
+ * adds both header variants and mirrors the body into the keep-alive variant.
+ * @param gzip Non-zero if the body is gzip-encoded.
+ * @param data The sample the body was rendered from, for the validators.
+ */
+void finish_cached_response(CachedResponse *cached, const char *content_type, int gzip, int body_cnt,
+                            uint64_t generation, const SystemData *data) {
+    size_t body_len = 0;
+    for (int i = 1; i <= body_cnt; i++) body_len += cached->iov[0][i].iov_len;
+    memcpy(&cached->iov[1][1], &cached->iov[0][1], (size_t)body_cnt * sizeof(struct iovec));
+
+    char etag[ETAG_SIZE], last_modified[HTTP_DATE_SIZE];
+    format_etag(data->timestamp, gzip, etag, sizeof(etag));
+    format_http_date((time_t)data->timestamp, last_modified, sizeof(last_modified));
+    int max_age = sample_max_age(data, wall_ms(), &cached->fresh_until_ms);
+
+    static const char *const connection[2] = { "close", "keep-alive" };
+    for (int v = 0; v < 2; v++) {
+        int head_len = snprintf(cached->head[v], RESPONSE_HEAD_SIZE,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n"
+            "%s"
+            "ETag: %s\r\n"
+            "Last-Modified: %s\r\n"
+            "Cache-Control: max-age=%d\r\n"
+            "Vary: Accept-Encoding\r\n"
+            "Connection: %s\r\n"
+            "\r\n",
+            content_type, body_len, gzip ? "Content-Encoding: gzip\r\n" : "",
+            etag, last_modified, max_age, connection[v]);
+        cached->iov[v][0].iov_base = cached->head[v];
+        cached->iov[v][0].iov_len = (size_t)head_len;
+        cached->len[v] = (size_t)head_len + body_len;
+    }
+
+    cached->iovcnt = body_cnt + 1;
+    cached->refs = 1;
+    cached->generation = generation;
+    cached->timestamp = data->timestamp;
+    cached->interval_ms = data->interval_ms;
+}
+
+/**
+ * Builds the dashboard response for the current sample. Only the header
+ * and the slot values are formatted; static segments are referenced in place.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_dashboard_response(void) {
+    SystemData data;
+    uint64_t generation;
+    if (read_sample(&data, &generation) < 0) return NULL;
+
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    if (!cached) return NULL;
+
+    size_t value_len[PAGE_SLOT_COUNT];
+    render_page_slots(&data, cached->values, value_len);
+
+    struct iovec *body = &cached->iov[0][1];
+    for (int i = 0; i < page_part_count; i++) {
+        const PagePart *part = &page_parts[i];
+        if (part->slot < 0) {
+            body[i].iov_base = (void *)part->text;
+            body[i].iov_len = part->len;
+        } else {
+            body[i].iov_base = cached->values[part->slot];
+            body[i].iov_len = value_len[part->slot];
+        }
+    }
+
+    finish_cached_response(cached, "text/html", 0, page_part_count, generation, &data);
+    return cached;
+}
+
+/**
+ * Builds the gzip-encoded dashboard: the static segments deflated at
+ * startup, interleaved with this generation's slot values deflated here,
+ * inside one gzip member whose CRC is combined from the pieces.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_dashboard_gzip_response(void) {
+    SystemData data;
+    uint64_t generation;
+    if (read_sample(&data, &generation) < 0) return NULL;
+
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    unsigned char *gz = malloc(GZIP_HEADER_SIZE + PAGE_SLOT_COUNT * GZIP_SLOT_SIZE + GZIP_TRAILER_SIZE);
+    z_stream zs = {0};
+    // Slot values are a few bytes long: a small window keeps the per-sample setup cheap
+    if (!cached || !gz || deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -9, 1, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(cached);
+        free(gz);
+        return NULL;
+    }
+    cached->owned_body = gz;
+
+    size_t value_len[PAGE_SLOT_COUNT];
+    render_page_slots(&data, cached->values, value_len);
+
+    unsigned char *slot_gz[PAGE_SLOT_COUNT];
+    size_t slot_gz_len[PAGE_SLOT_COUNT];
+    uLong slot_crc[PAGE_SLOT_COUNT];
+    for (int i = 0; i < PAGE_SLOT_COUNT; i++) {
+        slot_gz[i] = gz + GZIP_HEADER_SIZE + (size_t)i * GZIP_SLOT_SIZE;
+        slot_gz_len[i] = deflate_piece(&zs, cached->values[i], value_len[i], slot_gz[i], GZIP_SLOT_SIZE);
+        slot_crc[i] = crc32(0L, (const Bytef *)cached->values[i], (uInt)value_len[i]);
+        if (slot_gz_len[i] == 0) {
+            deflateEnd(&zs);
+            release_cached_response(cached);
+            return NULL;
+        }
+    }
+    deflateEnd(&zs);
+
+    struct iovec *body = &cached->iov[0][1];
+    write_gzip_header(gz);
+    body[0].iov_base = gz;
+    body[0].iov_len = GZIP_HEADER_SIZE;
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    size_t total = 0;
+    for (int i = 0; i < page_part_count; i++) {
+        const PagePart *part = &page_parts[i];
+        if (part->slot < 0) {
+            body[i + 1].iov_base = part->gz;
+            body[i + 1].iov_len = part->gz_len;
+            crc = crc32_combine(crc, part->crc, (z_off_t)part->len);
+            total += part->len;
+        } else {
+            body[i + 1].iov_base = slot_gz[part->slot];
+            body[i + 1].iov_len = slot_gz_len[part->slot];
+            crc = crc32_combine(crc, slot_crc[part->slot], (z_off_t)value_len[part->slot]);
+            total += value_len[part->slot];
+        }
+    }
+
+    unsigned char *trailer = gz + GZIP_HEADER_SIZE + PAGE_SLOT_COUNT * GZIP_SLOT_SIZE;
+    write_gzip_trailer(trailer, crc, total);
+    body[page_part_count + 1].iov_base = trailer;
+    body[page_part_count + 1].iov_len = GZIP_TRAILER_SIZE;
+
+    finish_cached_response(cached, "text/html", 1, page_part_count + 2, generation, &data);
+    return cached;
+}
+
+/**
+ * Builds the /api/latest response: the newest sample's JSON line, as is.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_latest_json_response(void) {
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    char *body = malloc(RAW_SAMPLE_SIZE);
+    if (!cached || !body) {
+        free(cached);
+        free(body);
+        return NULL;
+    }
+
+    // Line, validators and generation all come from one snapshot
+    SystemData data;
+    uint64_t generation;
+    ssize_t len = read_sample_raw(body, RAW_SAMPLE_SIZE, &data, &generation);
+    if (len < 0) {
+        free(cached);
+        free(body);
+        return NULL;
+    }
+
+    // Keep only what the line needs for the lifetime of the generation
+    char *shrunk = realloc(body, len > 0 ? (size_t)len : 1);
+    if (shrunk) body = shrunk;
+
+    cached->owned_body = body;
+    cached->iov[0][1].iov_base = body;
+    cached->iov[0][1].iov_len = (size_t)len;
+    finish_cached_response(cached, "application/json", 0, 1, generation, &data);
+    return cached;
+}
+
+/**
+ * Compresses a whole body into one gzip member.
+ * @return malloc'ed buffer (length in *gz_len), or NULL on failure.
+ */
+unsigned char *gzip_body(const char *body, size_t len, size_t *gz_len) {
+    uLong size = compressBound((uLong)len) + 32; // Room for the gzip header and trailer
+    unsigned char *gz = malloc(size);
+    if (!gz) return NULL;
+
+    z_stream zs = {0};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(gz);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = (uInt)len;
+    zs.next_out = gz;
+    zs.avail_out = (uInt)size;
+    int ret = deflate(&zs, Z_FINISH);
+    *gz_len = zs.total_out;
+    deflateEnd(&zs);
+
+    if (ret != Z_STREAM_END) {
+        free(gz);
+        return NULL;
+    }
+    return gz;
+}
+
+/**
+ * Builds the gzip-encoded variant of another cached response, compressed
+ * once per generation.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_gzip_of(CachedResponse *(*render)(void), const char *content_type) {
+    CachedResponse *plain = render();
+    if (!plain) return NULL;
+
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    size_t gz_len = 0;
+    unsigned char *gz = cached ? gzip_body(plain->owned_body, plain->iov[0][1].iov_len, &gz_len) : NULL;
+    if (!gz) {
+        free(cached);
+        release_cached_response(plain);
+        return NULL;
+    }
+
+    SystemData data;
+    data.timestamp = plain->timestamp;
+    data.interval_ms = plain->interval_ms;
+
+    cached->owned_body = gz;
+    cached->iov[0][1].iov_base = gz;
+    cached->iov[0][1].iov_len = gz_len;
+    finish_cached_response(cached, content_type, 1, 1, plain->generation, &data);
+    release_cached_response(plain);
+    return cached;
+}
+
+CachedResponse *render_latest_json_gzip_response(void) {
+    return render_gzip_of(render_latest_json_response, "application/json");
+}
+
+/* --- Prometheus exposition --- */
+
+// One numeric value of a sysmon JSON line: "cpu.per_core_pct" with index 3, ...
+typedef struct {
+    char path[JSON_PATH_SIZE];
+    int index;          // Position in the enclosing array, -1 outside arrays
+    double value;
+} JsonLeaf;
+
+typedef struct {
+    JsonLeaf *items;
+    size_t count;
+    size_t capacity;
+} JsonLeaves;
+
+/**
+ * JsonVisitor that appends every number to a JsonLeaves list.
+ */
+int json_collect_leaf(void *ctx, const char *path, size_t path_len, int index, double value) {
+    JsonLeaves *out = ctx;
+    if (out->count == out->capacity) {
+        size_t capacity = out->capacity ? out->capacity * 2 : 64;
+        JsonLeaf *items = realloc(out->items, capacity * sizeof(*items));
+        if (!items) return -1;
+        out->items = items;
+        out->capacity = capacity;
+    }
+    JsonLeaf *leaf = &out->items[out->count++];
+    memcpy(leaf->path, path, path_len + 1);
+    leaf->index = index;
+    leaf->value = value;
+    return 0;
+}
+
+/**
+ * A metric family and the JSON values it is built from. A path ending in
+ * '.' matches every member of that object, which becomes the "mode" label;
+ * array positions become the "core" label.
+ */
+typedef struct {
+    const char *path;
+    const char *name;
+    const char *type;
+    const char *help;
+    double scale;
+    int negative_absent; // sysmon reports unavailable readings as -1
+} MetricFamily;
+
+static const MetricFamily metric_families[] = {
+    { "timestamp", "sysmon_sample_timestamp_seconds", "gauge",
+      "Time the sample was taken, in seconds since the epoch.", 1, 0 },
+    { "uptime_sec", "sysmon_uptime_seconds", "gauge", "System uptime.", 1, 0 },
+    { "interval_ms", "sysmon_sample_interval_seconds", "gauge", "Configured sampling interval.", 0.001, 0 },
+    { "overruns", "sysmon_overruns_total", "counter", "Sampling ticks missed because a sample ran late.", 1, 0 },
+    { "cpu.temp_c", "sysmon_cpu_temperature_celsius", "gauge", "SoC temperature.", 1, 1 },
+    { "cpu.usage_pct", "sysmon_cpu_usage_percent", "gauge", "CPU busy time over the last interval, all cores.", 1, 1 },
+    { "cpu.per_core_pct", "sysmon_cpu_core_usage_percent", "gauge", "CPU busy time over the last interval, per core.", 1, 1 },
+    { "cpu.breakdown_pct.", "sysmon_cpu_mode_percent", "gauge", "Share of CPU time per /proc/stat mode, all cores.", 1, 1 },
+    { "cpu.per_core_breakdown_pct.", "sysmon_cpu_core_mode_percent", "gauge", "Share of CPU time per /proc/stat mode, per core.", 1, 1 },
+    { "memory.total_kb", "sysmon_memory_total_bytes", "gauge", "MemTotal from /proc/meminfo.", 1024, 0 },
+    { "memory.free_kb", "sysmon_memory_free_bytes", "gauge", "MemFree from /proc/meminfo.", 1024, 0 },
+    { "memory.available_kb", "sysmon_memory_available_bytes", "gauge", "MemAvailable from /proc/meminfo.", 1024, 0 },
+    { "memory.buffers_kb", "sysmon_memory_buffers_bytes", "gauge", "Buffers from /proc/meminfo.", 1024, 0 },
+    { "memory.cached_kb", "sysmon_memory_cached_bytes", "gauge", "Cached from /proc/meminfo.", 1024, 0 },
+    { "memory.shmem_kb", "sysmon_memory_shmem_bytes", "gauge", "Shmem from /proc/meminfo.", 1024, 0 },
+    { "memory.dirty_kb", "sysmon_memory_dirty_bytes", "gauge", "Dirty from /proc/meminfo.", 1024, 0 },
+    { "memory.swap_total_kb", "sysmon_memory_swap_total_bytes", "gauge", "SwapTotal from /proc/meminfo.", 1024, 0 },
+    { "memory.swap_free_kb", "sysmon_memory_swap_free_bytes", "gauge", "SwapFree from /proc/meminfo.", 1024, 0 },
+    { "memory.used_pct", "sysmon_memory_used_percent", "gauge", "Memory in use (total minus available).", 1, 1 },
+};
+
+/**
+ * Writes the metric families of one sample JSON line in the Prometheus
+ * text format (0.0.4), grouped by family with HELP and TYPE lines.
+ */
+void format_metrics(const JsonLeaves *leaves, RawSample *out) {
+    for (size_t f = 0; f < sizeof(metric_families) / sizeof(metric_families[0]); f++) {
+        const MetricFamily *family = &metric_families[f];
+        size_t path_len = strlen(family->path);
+        int by_member = (family->path[path_len - 1] == '.');
+
+        raw_append(out, "# HELP %s %s\n# TYPE %s %s\n", family->name, family->help, family->name, family->type);
+        for (size_t i = 0; i < leaves->count; i++) {
+            const JsonLeaf *leaf = &leaves->items[i];
+            if (by_member ? strncmp(leaf->path, family->path, path_len) != 0 || leaf->path[path_len] == '\0'
+                          : strcmp(leaf->path, family->path) != 0) {
+                continue;
+            }
+            if (family->negative_absent && leaf->value < 0) continue;
+
+            raw_append(out, "%s", family->name);
+            if (by_member && leaf->index >= 0) {
+                raw_append(out, "{core=\"%d\",mode=\"%s\"}", leaf->index, leaf->path + path_len);
+            } else if (by_member) {
+                raw_append(out, "{mode=\"%s\"}", leaf->path + path_len);
+            } else if (leaf->index >= 0) {
+                raw_append(out, "{core=\"%d\"}", leaf->index);
+            }
+            raw_append(out, " %.15g\n", leaf->value * family->scale);
+        }
+    }
+}
+
+/**
+ * Builds the /metrics response from the newest sample's JSON line.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_metrics_response(void) {
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    char *line = malloc(RAW_SAMPLE_SIZE);
+    RawSample out = { malloc(METRICS_BUFFER_SIZE), METRICS_BUFFER_SIZE, 0 };
+    JsonLeaves leaves = { NULL, 0, 0 };
+
+    // The exposition and its validators must describe the same sample
+    SystemData data;
+    uint64_t generation;
+    ssize_t len = (cached && line && out.buf) ? read_sample_raw(line, RAW_SAMPLE_SIZE, &data, &generation) : -1;
+
+    char path[JSON_PATH_SIZE] = "";
+    if (len < 0 || !json_walk(line, line + len, path, 0, -1, 0, json_collect_leaf, &leaves)) {
+        free(cached);
+        free(line);
+        free(out.buf);
+        free(leaves.items);
+        return NULL;
+    }
+    format_metrics(&leaves, &out);
+    free(line);
+    free(leaves.items);
+
+    char *shrunk = realloc(out.buf, out.len > 0 ? out.len : 1);
+    if (shrunk) out.buf = shrunk;
+
+    cached->owned_body = out.buf;
+    cached->iov[0][1].iov_base = out.buf;
+    cached->iov[0][1].iov_len = out.len;
+    finish_cached_response(cached, METRICS_CONTENT_TYPE, 0, 1, generation, &data);
+    return cached;
+}
+
+CachedResponse *render_metrics_gzip_response(void) {
+    return render_gzip_of(render_metrics_response, METRICS_CONTENT_TYPE);
+}
+
+typedef CachedResponse *(*RenderFn)(void);
+
+/**
+ * Returns one of the worker's cached responses, re-rendering it only
+ * when a newer sample generation has been published or the max-age in
+ * its header has run down by a second.
+ */
+CachedResponse *get_cached_response(EventLoop *loop, CacheId id, RenderFn render) {
+    CachedResponse *cached = loop->cache[id];
+    if (cached && cached->generation == sample_generation() &&
+        (cached->fresh_until_ms == INT64_MAX || wall_ms() < cached->fresh_until_ms)) {
+        return cached;
+    }
+
+    CachedResponse *fresh = render();
+    if (!fresh) return NULL;
+
+    release_cached_response(cached);
+    loop->cache[id] = fresh;
+    return fresh;
+}
+
+/**
+ * Points the connection at a cached response, holding a reference until it is sent.
+ */
+void send_cached_response(Connection *conn, CachedResponse *cached) {
+    int variant = conn->keep_alive ? 1 : 0;
+    cached->refs++;
+    conn->out_cached = cached;
+    conn->out_iov = cached->iov[variant];
+    conn->out_iovcnt = conn->head_only ? 1 : cached->iovcnt;
+    conn->out_len = conn->head_only ? cached->iov[variant][0].iov_len : cached->len[variant];
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+}
+
+/**
+ * Answers a conditional request whose copy is still current: validators
+ * and freshness only, nothing rendered.
+ */
+void send_not_modified(Connection *conn, const SystemData *data, const char *etag) {
+    char last_modified[HTTP_DATE_SIZE];
+    format_http_date((time_t)data->timestamp, last_modified, sizeof(last_modified));
+
+    int len = snprintf(conn->out, sizeof(conn->out),
+        "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Cache-Control: max-age=%d\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        etag, last_modified, sample_max_age(data, wall_ms(), NULL), conn->keep_alive ? "keep-alive" : "close");
+
+    conn->small_iov.iov_base = conn->out;
+    conn->small_iov.iov_len = (len < 0) ? 0 : (size_t)len;
+    conn->out_iov = &conn->small_iov;
+    conn->out_iovcnt = 1;
+    conn->out_len = conn->small_iov.iov_len;
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+}
+
+/**
+ * Sends the gzip or identity variant of a cached response, depending on
+ * the request's Accept-Encoding, and counts the choice in the worker stats.
+ * Conditional requests for the current sample get a 304 instead.
+ * @return 0 if a response was queued, -1 if no sample is available.
+ */
+int send_negotiated(EventLoop *loop, Connection *conn, const HttpRequest *req,
+                    CacheId identity_id, RenderFn render_identity,
+                    CacheId gzip_id, RenderFn render_gzip) {
+    SystemData data;
+    if (read_sample(&data, NULL) < 0) return -1;
+
+    if (req->if_none_match[0] || req->if_modified_since >= 0) {
+        char etag[ETAG_SIZE];
+        format_etag(data.timestamp, req->accept_gzip, etag, sizeof(etag));
+        if (not_modified(req, &data, etag)) {
+            send_not_modified(conn, &data, etag);
+            atomic_fetch_add_explicit(&loop->stats.not_modified, 1, memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    CachedResponse *cached = req->accept_gzip ? get_cached_response(loop, gzip_id, render_gzip) : NULL;
+    int gzip = (cached != NULL);
+    if (!cached) cached = get_cached_response(loop, identity_id, render_identity);
+    if (!cached) return -1;
+
+    send_cached_response(conn, cached);
+
+    ServerStats *stats = &loop->stats;
+    atomic_fetch_add_explicit(gzip ? &stats->gzip_responses : &stats->identity_responses, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(gzip ? &stats->gzip_bytes : &stats->identity_bytes,
+                              (unsigned long)conn->out_len, memory_order_relaxed);
+    return 0;
+}
+
+void send_no_data(Connection *conn) {
+    static const char no_data[] = "No data available yet.";
+    set_response(conn, "503 Service Unavailable", "text/plain", no_data, sizeof(no_data) - 1);
+}
+
+/**
+ * Builds the /events message for the current sample: the dashboard slot
+ * values as one compact JSON object.
+ * @return New cache entry holding one reference, or NULL if no sample is available.
+ */
+CachedResponse *render_sse_event(void) {
+    SystemData data;
+    uint64_t generation;
+    if (read_sample(&data, &generation) < 0) return NULL;
+
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    char *event = malloc(SSE_EVENT_SIZE);
+    if (!cached || !event) {
+        free(cached);
+        free(event);
+        return NULL;
+    }
+
+    size_t value_len[PAGE_SLOT_COUNT];
+    render_page_slots(&data, cached->values, value_len);
+
+    size_t len = 0;
+    for (int i = 0; i < PAGE_SLOT_COUNT; i++) {
+        int n = snprintf(event + len, SSE_EVENT_SIZE - len, "%s\"%s\":\"%.*s\"",
+                         (i == 0) ? "data: {" : ",", page_slot_names[i], (int)value_len[i], cached->values[i]);
+        if (n > 0) len += ((size_t)n < SSE_EVENT_SIZE - len) ? (size_t)n : 0;
+    }
+    int n = snprintf(event + len, SSE_EVENT_SIZE - len, "}\n\n");
+    if (n > 0) len += ((size_t)n < SSE_EVENT_SIZE - len) ? (size_t)n : 0;
+
+    // Events are pushed on an already established stream: no header, same bytes for both variants
+    cached->owned_body = event;
+    for (int v = 0; v < 2; v++) {
+        cached->iov[v][0].iov_base = event;
+        cached->iov[v][0].iov_len = len;
+        cached->len[v] = len;
+    }
+    cached->iovcnt = 1;
+    cached->refs = 1;
+    cached->generation = generation;
+    cached->timestamp = data.timestamp;
+    cached->fresh_until_ms = INT64_MAX; // No max-age in events
+    return cached;
+}
+
+/**
+ * Queues the latest sample event on a subscriber if it has not seen it yet.
+ * @return 1 if an event was queued, 0 if the subscriber is up to date.
+ */
+int queue_sse_event(EventLoop *loop, Connection *conn) {
+    CachedResponse *event = get_cached_response(loop, CACHE_SSE_EVENT, render_sse_event);
+    if (!event || event->generation == conn->event_generation) return 0;
+
+    conn->event_generation = event->generation;
+    send_cached_response(conn, event);
+    return 1;
+}
+
+/* --- Routes --- */
+
+void handle_dashboard(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    if (send_negotiated(loop, conn, req, CACHE_DASHBOARD, render_dashboard_response,
+                        CACHE_DASHBOARD_GZIP, render_dashboard_gzip_response) != 0) {
+        // Keep the historical behaviour for browsers: a plain 200 page
+        static const char no_data[] = "No data available yet.";
+        set_response(conn, "200 OK", "text/plain", no_data, sizeof(no_data) - 1);
+    }
+}
+
+void handle_api_latest(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    if (send_negotiated(loop, conn, req, CACHE_LATEST_JSON, render_latest_json_response,
+                        CACHE_LATEST_JSON_GZIP, render_latest_json_gzip_response) != 0) {
+        send_no_data(conn);
+    }
+}
+
+typedef void (*RouteHandler)(EventLoop *loop, Connection *conn, const HttpRequest *req);
+
+typedef struct {
+    const char *path;
+    RouteHandler handler;
+} Route;
+
+/**
+ * Reads a numeric query parameter ("from=1700000000.5").
+ * @return 1 if present and valid, 0 if absent, -1 if malformed.
+ */
+int query_double(const char *path, const char *name, double *out) {
+    const char *query = strchr(path, '?');
+    size_t name_len = strlen(name);
+
+    for (const char *p = query; p; p = strchr(p + 1, '&')) {
+        if (strncmp(p + 1, name, name_len) != 0 || p[1 + name_len] != '=') continue;
+
+        const char *value = p + 2 + name_len;
+        char *end;
+        errno = 0;
+        *out = strtod(value, &end);
+        if (errno || end == value || (*end != '\0' && *end != '&')) return -1;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Streams the log records taken between from and to (seconds since the
+ * epoch, both optional and inclusive): JSON lines as NDJSON, or binary
+ * records behind a copy of the log header so the body is itself a log.
+ * The response is sent by send_range_response() once the lookup thread
+ * has located the bytes.
+ */
+void handle_api_range(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    double from = 0, to = 1e18;
+    if (query_double(req->path, "from", &from) < 0 || query_double(req->path, "to", &to) < 0 || from > to) {
+        static const char bad[] = "Expected /api/range?from=SEC&to=SEC";
+        set_response(conn, "400 Bad Request", "text/plain", bad, sizeof(bad) - 1);
+        return;
+    }
+
+    int fd = open(MONITOR_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        send_no_data(conn);
+        return;
+    }
+    // The index lookup reads the log: leave it to the lookup thread
+    if (queue_range_lookup(loop, conn, fd, from, to) != 0) {
+        close(fd);
+        static const char busy[] = "Out of memory";
+        set_response(conn, "503 Service Unavailable", "text/plain", busy, sizeof(busy) - 1);
+    }
+}
+
+/**
+ * Answers an /api/range request once its lookup is done: the headers,
+ * then the located log bytes streamed with sendfile().
+ */
+void send_range_response(Connection *conn, const RangeLookup *lookup) {
+    int fd = lookup->fd;
+    off_t start = lookup->start, end = lookup->end;
+    const SysmonLogHeader *header = &lookup->header;
+    int binary = lookup->binary;
+    if (binary < 0) {
+        // Not indexed yet (or just rotated): the sampler catches up within a poll
+        close(fd);
+        send_no_data(conn);
+        return;
+    }
+
+    size_t prefix = binary ? sizeof(*header) : 0;
+    int len = snprintf(conn->out, sizeof(conn->out),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %lld\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        binary ? "application/octet-stream" : "application/x-ndjson",
+        (long long)(end - start) + (long long)prefix, conn->keep_alive ? "keep-alive" : "close");
+    size_t head_len = (len < 0) ? 0 : (size_t)len;
+    if (!conn->head_only) {
+        memcpy(conn->out + head_len, header, prefix);
+        head_len += prefix;
+    }
+
+    conn->small_iov.iov_base = conn->out;
+    conn->small_iov.iov_len = head_len;
+    conn->out_iov = &conn->small_iov;
+    conn->out_iovcnt = 1;
+    conn->out_len = head_len;
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+
+    if (conn->head_only || end == start) {
+        close(fd);
+        return;
+    }
+    conn->file_fd = fd;
+    conn->file_offset = start;
+    conn->file_end = end;
+}
+
+/**
+ * Serves one rollup resolution, optionally limited to [from, to]. The
+ * response is built once for this request; it carries the validators of
+ * the current sample, so pollers get a 304 until the next one arrives.
+ */
+void handle_api_rollup(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    double res = 60, from = 0, to = 1e18;
+    int r = -1;
+    if (query_double(req->path, "res", &res) >= 0 && query_double(req->path, "from", &from) >= 0 &&
+        query_double(req->path, "to", &to) >= 0 && from <= to) {
+        for (int i = 0; i < ROLLUP_RESOLUTION_COUNT; i++) {
+            if (res == rollup_resolutions[i]) r = i;
+        }
+    }
+    if (r < 0) {
+        static const char bad[] = "Expected /api/rollup?res=1|10|60|3600&from=SEC&to=SEC";
+        set_response(conn, "400 Bad Request", "text/plain", bad, sizeof(bad) - 1);
+        return;
+    }
+
+    SystemData data;
+    uint64_t generation;
+    if (read_sample(&data, &generation) < 0) {
+        send_no_data(conn);
+        return;
+    }
+
+    char etag[ETAG_SIZE];
+    format_etag(data.timestamp, 0, etag, sizeof(etag));
+    if ((req->if_none_match[0] || req->if_modified_since >= 0) && not_modified(req, &data, etag)) {
+        send_not_modified(conn, &data, etag);
+        atomic_fetch_add_explicit(&loop->stats.not_modified, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t len;
+    CachedResponse *cached = calloc(1, sizeof(*cached));
+    char *body = cached ? format_rollup(r, from, to, &len) : NULL;
+    if (!body) {
+        free(cached);
+        send_no_data(conn);
+        return;
+    }
+
+    cached->owned_body = body;
+    cached->iov[0][1].iov_base = body;
+    cached->iov[0][1].iov_len = len;
+    finish_cached_response(cached, "application/json", 0, 1, generation, &data);
+    send_cached_response(conn, cached);
+    release_cached_response(cached); // The connection holds the only reference now
+}
+
+void handle_metrics(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    if (send_negotiated(loop, conn, req, CACHE_METRICS, render_metrics_response,
+                        CACHE_METRICS_GZIP, render_metrics_gzip_response) != 0) {
+        send_no_data(conn);
+    }
+}
+
+/**
+ * Server-Sent Events stream: the connection stays open and receives one
+ * small event per new sample instead of reloading the whole page. The
+ * stream has no length and ends when the connection does, so it is
+ * announced as "Connection: close" and never reused for another request.
+ */
+void handle_events(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    static const char head[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "retry: 2000\n\n";
+
+    // HEAD gets the headers, without the retry field or a subscription
+    size_t len = req->head ? sizeof(head) - 1 - strlen("retry: 2000\n\n") : sizeof(head) - 1;
+    memcpy(conn->out, head, len);
+    conn->small_iov.iov_base = conn->out;
+    conn->small_iov.iov_len = len;
+    conn->out_iov = &conn->small_iov;
+    conn->out_iovcnt = 1;
+    conn->out_len = len;
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+    conn->keep_alive = 0;
+    if (req->head) return;
+
+    conn->streaming = 1;
+    conn->event_generation = 0;
+    add_subscriber(loop, conn);
+}
+
+static const Route routes[] = {
+    { "/",           handle_dashboard },
+    { "/index.html", handle_dashboard },
+    { "/api/latest", handle_api_latest },
+    { "/api/range",  handle_api_range },
+    { "/api/rollup", handle_api_rollup },
+    { "/metrics",    handle_metrics },
+    { "/events",     handle_events },
+};
+
+/**
+ * Generates the response for one parsed request by dispatching on its path.
+ */
+void build_response(EventLoop *loop, Connection *conn, const HttpRequest *req) {
+    atomic_fetch_add_explicit(&loop->stats.requests, 1, memory_order_relaxed);
+    conn->head_only = req->head;
+
+    // Ignore the query string when matching
+    size_t path_len = strcspn(req->path, "?");
+
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        if (strlen(routes[i].path) == path_len && strncmp(routes[i].path, req->path, path_len) == 0) {
+            routes[i].handler(loop, conn, req);
+            return;
+        }
+    }
+
+    static const char not_found[] = "Not Found";
+    set_response(conn, "404 Not Found", "text/plain", not_found, sizeof(not_found) - 1);
+}
+
+/**
+ * Answers a request that cannot be served and closes after the response.
+ */
+void reject_request(Connection *conn, const char *status) {
+    conn->keep_alive = 0;
+    set_response(conn, status, "text/plain", status, strlen(status));
+}
+
+/**
+ * Flushes as much of the pending response as the socket accepts, as one
+ * scatter-gather send per attempt, then any log range with sendfile().
+ * MSG_MORE is set while another pipelined request is already buffered
+ * so consecutive responses leave as one packet train.
+ * @return 1 when the response is fully sent, 0 if the socket is full, -1 on error.
+ */
+int flush_output(EventLoop *loop, Connection *conn) {
+    int more = memmem(conn->in, conn->in_len, "\r\n\r\n", 4) != NULL || conn->file_fd >= 0;
+    assert(conn->out_iovcnt <= RESPONSE_IOV_MAX);
+
+    while (conn->out_sent < conn->out_len) {
+        // Skip the segments already sent
+        struct iovec iov[RESPONSE_IOV_MAX];
+        int cnt = 0;
+        size_t skip = conn->out_sent;
+        for (int i = 0; i < conn->out_iovcnt; i++) {
+            size_t len = conn->out_iov[i].iov_len;
+            if (skip >= len) {
+                skip -= len;
+                continue;
+            }
+            iov[cnt].iov_base = (char *)conn->out_iov[i].iov_base + skip;
+            iov[cnt].iov_len = len - skip;
+            skip = 0;
+            cnt++;
+        }
+
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)cnt };
+        ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0; // Wait for EPOLLOUT
+            return -1;
+        }
+        conn->out_sent += (size_t)n;
+        touch_connection(loop, conn);
+    }
+
+    release_cached_response(conn->out_cached);
+    conn->out_cached = NULL;
+
+    while (conn->file_fd >= 0 && conn->file_offset < conn->file_end) {
+        off_t left = conn->file_end - conn->file_offset;
+        ssize_t n = sendfile(conn->fd, conn->file_fd, &conn->file_offset,
+                             (left < SENDFILE_CHUNK) ? (size_t)left : SENDFILE_CHUNK);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        if (n == 0) return -1; // Log truncated under us: the promised length cannot be met
+        touch_connection(loop, conn);
+    }
+    if (conn->file_fd >= 0) {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+    }
+    return 1;
+}
+
+/**
+ * Reads as much as fits into the request buffer.
+ * @return 1 if the buffer is full, 0 once the socket is drained, -1 on error.
+ */
+int read_input(EventLoop *loop, Connection *conn) {
+    while (conn->in_len < sizeof(conn->in)) {
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - conn->in_len);
+        if (n == 0) {
+            conn->peer_closed = 1;
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        conn->in_len += (size_t)n;
+        touch_connection(loop, conn);
+    }
+    return 1;
+}
+
+/**
+ * Drops consumed bytes from the front of the request buffer.
+ */
+void consume_input(Connection *conn, size_t n) {
+    memmove(conn->in, conn->in + n, conn->in_len - n);
+    conn->in_len -= n;
+}
+
+/**
+ * Answers buffered requests in order until the connection must wait
+ * for more input or for the socket to drain.
+ * @return 0 to keep the connection, -1 if it must be closed.
+ */
+int serve_connection(EventLoop *loop, Connection *conn) {
+    for (;;) {
+        // Pipelined requests wait until the range lookup has been answered
+        if (conn->state == CONN_LOOKUP) return 0;
+
+        if (conn->state == CONN_WRITING) {
+            int r = flush_output(loop, conn);
+            if (r <= 0) return r;
+            if (conn->streaming) {
+                conn->state = CONN_STREAMING;
+            } else {
+                if (!conn->keep_alive) return -1;
+                conn->state = CONN_READING;
+            }
+        }
+
+        if (conn->state == CONN_STREAMING) {
+            // Subscribers have nothing more to say; drop anything they send
+            conn->in_len = 0;
+            if (conn->peer_closed) return -1;
+            if (!queue_sse_event(loop, conn)) return 0;
+            continue;
+        }
+
+        // Skip the body of the previous request (e.g. a POST we answered anyway)
+        if (conn->discard > 0) {
+            size_t n = (conn->discard < conn->in_len) ? (size_t)conn->discard : conn->in_len;
+            consume_input(conn, n);
+            conn->discard -= n;
+            if (conn->discard > 0) return conn->peer_closed ? -1 : 0;
+        }
+
+        HttpRequest req;
+        int r = parse_request(conn->in, conn->in_len, &req);
+        if (r == 0) {
+            if (conn->peer_closed) return -1;
+            if (conn->in_len < sizeof(conn->in)) return 0; // Wait for the rest of the head
+            reject_request(conn, "431 Request Header Fields Too Large");
+            continue;
+        }
+        if (r < 0) {
+            reject_request(conn, "400 Bad Request");
+            continue;
+        }
+
+        consume_input(conn, req.head_len);
+        conn->discard = req.content_length;
+        conn->keep_alive = req.keep_alive;
+        build_response(loop, conn, &req);
+    }
+}
+
+/**
+ * Pushes the new sample to every idle /events subscriber of the worker.
+ * Subscribers still flushing an older event pick it up when they finish.
+ */
+void notify_subscribers(EventLoop *loop) {
+    uint64_t count;
+    while (read(loop->notify_fd, &count, sizeof(count)) > 0) {
+        // Drain the eventfd
+    }
+
+    Connection *conn = loop->subscribers;
+    while (conn) {
+        Connection *next = conn->sub_next; // conn may be closed below
+        if (conn->state == CONN_STREAMING && serve_connection(loop, conn) < 0) {
+            close_connection(loop, conn);
+        }
+        conn = next;
+    }
+}
+
+/**
+ * Answers the connections whose range lookups the lookup thread has
+ * finished, and drops the lookups of connections closed meanwhile.
+ */
+void finish_range_lookups(EventLoop *loop) {
+    uint64_t count;
+    while (read(loop->lookup_fd, &count, sizeof(count)) > 0) {
+        // Drain the eventfd
+    }
+
+    pthread_mutex_lock(&loop->lookup_lock);
+    RangeLookup *lookup = loop->lookups_done;
+    loop->lookups_done = NULL;
+    pthread_mutex_unlock(&loop->lookup_lock);
+
+    while (lookup) {
+        RangeLookup *next = lookup->next;
+        Connection *conn = lookup->conn;
+        if (conn) {
+            conn->lookup = NULL;
+            send_range_response(conn, lookup);
+            if (serve_connection(loop, conn) < 0) close_connection(loop, conn);
+        } else {
+            close(lookup->fd);
+        }
+        free(lookup);
+        lookup = next;
+    }
+}
+
+/**
+ * Advances a connection after an epoll event: reads what is available,
+ * answers complete requests, and repeats while the request buffer was
+ * full (edge-triggered sockets will not signal those bytes again).
+ * @return 0 to keep the connection, -1 once it has been closed.
+ */
+int drive_connection(EventLoop *loop, Connection *conn) {
+    for (;;) {
+        int r = read_input(loop, conn);
+        if (r < 0 || serve_connection(loop, conn) < 0) {
+            close_connection(loop, conn);
+            return -1;
+        }
+        // Stop once the socket is drained, or while the buffer stays full behind a pending write
+        if (r == 0 || conn->in_len == sizeof(conn->in)) return 0;
+    }
+}
+
+/**
+ * Accepts every pending connection on the (edge-triggered) listener.
+ */
+void accept_connections(EventLoop *loop) {
+    for (;;) {
+        int client_fd = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+
+        Connection *conn = calloc(1, sizeof(*conn));
+        if (!conn) {
+            close(client_fd);
+            continue;
+        }
+        conn->fd = client_fd;
+        conn->file_fd = -1;
+        conn->state = CONN_READING;
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn };
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            perror("epoll_ctl");
+            close(client_fd);
+            free(conn);
+            continue;
+        }
+        loop->connections++;
+        touch_connection(loop, conn);
+    }
+}
+
+/**
+ * Sends an SSE comment line to a subscriber that has had nothing to
+ * receive, so it (and any proxy in between) knows the stream is alive.
+ * @return 0 to keep the connection, -1 if it must be closed.
+ */
+int send_sse_heartbeat(EventLoop *loop, Connection *conn) {
+    static const char heartbeat[] = ":\n\n";
+    memcpy(conn->out, heartbeat, sizeof(heartbeat) - 1);
+    conn->small_iov.iov_base = conn->out;
+    conn->small_iov.iov_len = sizeof(heartbeat) - 1;
+    conn->out_iov = &conn->small_iov;
+    conn->out_iovcnt = 1;
+    conn->out_len = sizeof(heartbeat) - 1;
+    conn->out_sent = 0;
+    conn->state = CONN_WRITING;
+    touch_connection(loop, conn);
+    return serve_connection(loop, conn);
+}
+
+/**
+ * Closes connections idle for longer than the configured timeout.
+ * Subscribers waiting for the next sample get a heartbeat instead; one
+ * that has not taken any bytes for that long is closed like the rest.
+ * @return Milliseconds until the next connection expires, or -1 if none.
+ */
+int expire_idle_connections(EventLoop *loop) {
+    int64_t now = now_ms();
+    while (loop->idle_head) {
+        Connection *conn = loop->idle_head;
+        int64_t remaining = conn->last_active_ms + loop->idle_timeout_ms - now;
+        if (remaining > 0) return (int)remaining;
+        if (conn->state != CONN_STREAMING || send_sse_heartbeat(loop, conn) < 0) {
+            close_connection(loop, conn);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Waits for one batch of epoll events (or the next idle expiry) and handles it.
+ */
+void poll_event_loop(EventLoop *loop) {
+    struct epoll_event events[MAX_EVENTS];
+
+    int timeout = expire_idle_connections(loop);
+    free_closed_connections(loop);
+    int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout);
+    if (n < 0) {
+        if (errno == EINTR) return;
+        error_die("epoll_wait");
+    }
+
+    for (int i = 0; i < n; i++) {
+        Connection *conn = events[i].data.ptr;
+        if (!conn) {
+            accept_connections(loop);
+            continue;
+        }
+        if ((void *)conn == (void *)&loop->notify_fd) {
+            notify_subscribers(loop);
+            continue;
+        }
+        if ((void *)conn == (void *)&loop->lookup_fd) {
+            finish_range_lookups(loop);
+            continue;
+        }
+        if (conn->closed) continue; // Closed by an earlier event of this batch
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            close_connection(loop, conn);
+            continue;
+        }
+        // EPOLLRDHUP is seen as a 0-byte read, after any pipelined requests are answered
+        drive_connection(loop, conn);
+    }
+}
+
+void run_event_loop(EventLoop *loop) {
+    while (1) {
+        poll_event_loop(loop);
+    }
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--port N] [--idle-timeout SEC] [--threads N] [--backlog N] [--stats SEC] [--rollup-points N]\n"
+        "  -p, --port N             Listening port (default %d)\n"
+        "  -t, --idle-timeout SEC   Close connections idle for SEC seconds (default %d)\n"
+        "  -j, --threads N          Worker threads, one SO_REUSEPORT listener each (default 1)\n"
+        "  -b, --backlog N          listen() backlog per worker (default %d)\n"
+        "  -s, --stats SEC          Print request and encoding stats every SEC seconds, 0 to disable (default %d)\n"
+        "  -r, --rollup-points N    Buckets kept per rollup resolution; N x %zu bytes in all (default %d)\n",
+        prog, PORT, DEFAULT_IDLE_TIMEOUT_SEC, BACKLOG, DEFAULT_STATS_INTERVAL_SEC,
+        sizeof(RollupBucket) * ROLLUP_RESOLUTION_COUNT, DEFAULT_ROLLUP_POINTS);
+}
+
+/**
+ * Matches "--name=value", "--name value" or "-n value" at argv[*i].
+ * @return Pointer to the value, or NULL if argv[*i] is a different option.
+ */
+const char *option_value(int argc, char **argv, int *i, const char *name, const char *short_name) {
+    size_t name_len = strlen(name);
+
+    if (strncmp(argv[*i], name, name_len) == 0 && argv[*i][name_len] == '=') {
+        return argv[*i] + name_len + 1;
+    }
+    if (strcmp(argv[*i], name) == 0 || strcmp(argv[*i], short_name) == 0) {
+        if (*i + 1 >= argc) return NULL;
+        return argv[++(*i)];
+    }
+    return NULL;
+}
+
+/**
+ * Parses a decimal option value within [min, max].
+ * @return 0 on success, -1 if out of range or malformed.
+ */
+int parse_long(const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(value, &end, 10);
+    if (errno || end == value || *end != '\0' || v < min || v > max) return -1;
+    *out = v;
+    return 0;
+}
+
+/**
+ * Parses command line options into a ServerConfig.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int parse_args(int argc, char **argv, ServerConfig *config) {
+    config->port = PORT;
+    config->idle_timeout_sec = DEFAULT_IDLE_TIMEOUT_SEC;
+    config->threads = 1;
+    config->backlog = BACKLOG;
+    config->stats_interval_sec = DEFAULT_STATS_INTERVAL_SEC;
+    config->rollup_points = DEFAULT_ROLLUP_POINTS;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value;
+        long v;
+
+        if ((value = option_value(argc, argv, &i, "--port", "-p"))) {
+            if (parse_long(value, 1, 65535, &v) != 0) return -1;
+            config->port = (int)v;
+        } else if ((value = option_value(argc, argv, &i, "--idle-timeout", "-t"))) {
+            if (parse_long(value, 1, 86400, &v) != 0) return -1;
+            config->idle_timeout_sec = (int)v;
+        } else if ((value = option_value(argc, argv, &i, "--threads", "-j"))) {
+            if (parse_long(value, 1, MAX_THREADS, &v) != 0) return -1;
+            config->threads = (int)v;
+        } else if ((value = option_value(argc, argv, &i, "--backlog", "-b"))) {
+            if (parse_long(value, 1, 65535, &v) != 0) return -1;
+            config->backlog = (int)v;
+        } else if ((value = option_value(argc, argv, &i, "--stats", "-s"))) {
+            if (parse_long(value, 0, 86400, &v) != 0) return -1;
+            config->stats_interval_sec = (int)v;
+        } else if ((value = option_value(argc, argv, &i, "--rollup-points", "-r"))) {
+            if (parse_long(value, 1, MAX_ROLLUP_POINTS, &v) != 0) return -1;
+            config->rollup_points = (int)v;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Opens a non-blocking listener. With SO_REUSEPORT every worker binds its
+ * own socket to the same port and the kernel spreads connections across them.
+ */
+int open_listener(const ServerConfig *config) {
+    int server_fd;
+    struct sockaddr_in server_addr;
+    int opt = 1;
+
+    // Create socket
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) error_die("socket failed");
+
+    // Force attach to port
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) error_die("setsockopt");
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) error_die("setsockopt SO_REUSEPORT");
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(config->port);
+
+    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) error_die("bind failed");
+    if (listen(server_fd, config->backlog) < 0) error_die("listen");
+
+    return server_fd;
+}
+
+/**
+ * Sets up a worker's event loop: its own listener, epoll set and eventfds.
+ */
+void init_event_loop(EventLoop *loop, const ServerConfig *config) {
+    loop->listen_fd = open_listener(config);
+    loop->idle_timeout_ms = (int64_t)config->idle_timeout_sec * 1000;
+    if ((loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) error_die("epoll_create1");
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->listen_fd, &ev) < 0) error_die("epoll_ctl");
+
+    // The sampler wakes the worker through this eventfd to push /events updates
+    if ((loop->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) error_die("eventfd");
+    struct epoll_event nev = { .events = EPOLLIN | EPOLLET, .data.ptr = &loop->notify_fd };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->notify_fd, &nev) < 0) error_die("epoll_ctl");
+
+    // The range lookup thread hands answered lookups back through this one
+    pthread_mutex_init(&loop->lookup_lock, NULL);
+    if ((loop->lookup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) error_die("eventfd");
+    struct epoll_event lev = { .events = EPOLLIN | EPOLLET, .data.ptr = &loop->lookup_fd };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->lookup_fd, &lev) < 0) error_die("epoll_ctl");
+}
+
+typedef struct {
+    int index;
+    pthread_t thread;
+    EventLoop loop;
+} Worker;
+
+void *worker_main(void *arg) {
+    Worker *worker = arg;
+
+    // Pin the worker to its own core so listeners and caches stay local
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->index % cpus, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    run_event_loop(&worker->loop);
+    return NULL;
+}
+
+/**
+ * Prints the requests served and the gzip/identity split since the last call.
+ */
+void log_stats(const Worker *workers, int count) {
+    static unsigned long last[6];
+    unsigned long total[6] = {0};
+
+    for (int i = 0; i < count; i++) {
+        const ServerStats *stats = &workers[i].loop.stats;
+        total[0] += atomic_load_explicit(&stats->requests, memory_order_relaxed);
+        total[1] += atomic_load_explicit(&stats->gzip_responses, memory_order_relaxed);
+        total[2] += atomic_load_explicit(&stats->identity_responses, memory_order_relaxed);
+        total[3] += atomic_load_explicit(&stats->gzip_bytes, memory_order_relaxed);
+        total[4] += atomic_load_explicit(&stats->identity_bytes, memory_order_relaxed);
+        total[5] += atomic_load_explicit(&stats->not_modified, memory_order_relaxed);
+    }
+    if (total[0] == last[0]) return; // Idle: keep the log quiet
+
+    printf("stats: requests=%lu gzip=%lu (%lu bytes) identity=%lu (%lu bytes) not_modified=%lu\n",
+           total[0] - last[0], total[1] - last[1], total[3] - last[3],
+           total[2] - last[2], total[4] - last[4], total[5] - last[5]);
+    fflush(stdout);
+    memcpy(last, total, sizeof(last));
+}
+
+int main(int argc, char **argv) {
+    ServerConfig config;
+    static Worker workers[MAX_THREADS];
+
+    if (parse_args(argc, argv, &config) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Writes to a peer that has gone away must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Bind every listener up front so port errors are reported before serving
+    for (int i = 0; i < config.threads; i++) {
+        workers[i].index = i;
+        init_event_loop(&workers[i].loop, &config);
+    }
+
+    init_line_scanner();
+    sysmon_crc32c_init();
+    compile_page_template();
+    compress_page_template();
+    init_rollups(config.rollup_points);
+    follower_init();
+    update_log_index();
+    refresh_sample();
+    start_range_lookup_thread();
+
+    for (int i = 0; i < config.threads; i++) {
+        errno = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (errno) error_die("pthread_create");
+    }
+
+    printf("Visual Monitor Server running on port %d with %d worker%s...\n",
+           config.port, config.threads, config.threads == 1 ? "" : "s");
+
+    // The main thread is the only writer of the shared sample snapshot. It wakes
+    // on log changes, and every SAMPLE_POLL_MS for the shm ring.
+    struct pollfd pfd = { .fd = follower.inotify_fd, .events = POLLIN };
+    const uint64_t one = 1;
+    int64_t next_stats_ms = now_ms() + (int64_t)config.stats_interval_sec * 1000;
+    while (1) {
+        if (poll(&pfd, pfd.fd >= 0 ? 1 : 0, SAMPLE_POLL_MS) < 0 && errno != EINTR) error_die("poll");
+
+        if (config.stats_interval_sec > 0 && now_ms() >= next_stats_ms) {
+            log_stats(workers, config.threads);
+            next_stats_ms += (int64_t)config.stats_interval_sec * 1000;
+        }
+
+        if (follow_log()) update_log_index();
+        int fresh = refresh_sample();
+        if (sample_from_shm) rollup_add_ring();
+        if (!fresh) continue;
+
+        for (int i = 0; i < config.threads; i++) {
+            if (write(workers[i].loop.notify_fd, &one, sizeof(one)) < 0) {
+                // Counter already pending; the worker will wake anyway
+            }
         }
-        handle_client(client_fd);
     }
 
     return 0;
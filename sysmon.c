@@ -4,243 +4,1044 @@
  * Low-level System Monitor for Raspberry Pi
  *
  * Reads kernel virtual files (/proc, /sys) to gather telemetry
- * and outputs JSON state to stdout.
+ * and outputs JSON lines (or fixed-size binary records) to stdout.
+ * With --shm, every sample is also published to a shared-memory ring.
+ * Every log record carries its length and a CRC32C so readers can skip
+ * records torn by a power cut.
+ *
+ * Output can be batched to spare SD cards: samples collect in a buffer and
+ * go out in one write() every --batch samples (ending on the last page
+ * boundary crossed) or --flush-sec seconds, with an optional fsync. Batching
+ * turns on --shm so readers still see every sample as it is taken, and
+ * SIGINT, SIGTERM and SIGHUP flush the buffer before exiting.
  * 
- * Compile: gcc -std=c11 -Wall -Wextra -O2 -o sm sysmon.c
+ * Compile: gcc -std=c11 -Wall -Wextra -O2 -o sm sysmon.c -lrt
+ * Usage:   ./sm [--interval MS] [--format json|binary|none] [--shm]
+ *               [--batch N] [--flush-sec SEC] [--fsync none|data|full]
  */
 
 #define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64 // Logs past 2 GiB on 32-bit Raspberry Pi OS
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#include "sysmon_record.h"
 
 /* --- Constants & Configuration --- */
 #define THERMAL_ZONE_PATH "/sys/class/thermal/thermal_zone0/temp"
 #define PROC_STAT_PATH    "/proc/stat"
 #define PROC_MEMINFO_PATH "/proc/meminfo"
-#define BUFFER_SIZE       1024
-#define JSON_BUFFER_SIZE  2048
+#define PROC_UPTIME_PATH  "/proc/uptime"
+#define MEMINFO_BUFFER_SIZE 4096
+#define STAT_BUFFER_SIZE  32768
+#define JSON_BUFFER_SIZE  32768
+#define MAX_CPUS          256
+#define MAX_CPU_SLOTS     (MAX_CPUS + 1) // Slot 0 holds the aggregate "cpu" line
+#define CPU_SLOT_VECTOR   4              // Slots per step of calculate_cpu_usage(): 32 bytes of doubles
+#define CPU_SLOT_STRIDE   ((MAX_CPU_SLOTS + CPU_SLOT_VECTOR - 1) & ~(CPU_SLOT_VECTOR - 1)) // Padded slot arrays
+#define DEFAULT_INTERVAL_MS 1000
+#define MIN_INTERVAL_MS     10
+#define MAX_INTERVAL_MS     3600000L
+#define NSEC_PER_SEC        1000000000L
+#define NSEC_PER_MSEC       1000000L
+#define MAX_BATCH_SAMPLES   100000
+#define MAX_FLUSH_SEC       86400
+#define SINK_BUFFER_SIZE    (256 * 1024) // Largest batch held in memory; a full buffer is flushed early
 
 /* --- Data Structures --- */
 
+/* Column order of the cpu lines in /proc/stat */
+enum {
+    CPU_USER,
+    CPU_NICE,
+    CPU_SYSTEM,
+    CPU_IDLE,
+    CPU_IOWAIT,
+    CPU_IRQ,
+    CPU_SOFTIRQ,
+    CPU_STEAL,
+    CPU_GUEST,
+    CPU_GUEST_NICE,
+    CPU_FIELD_COUNT
+};
+
+/**
+ * Structure-of-arrays snapshot of every cpu line in /proc/stat.
+ * field[CPU_IDLE][i] is the idle time of slot i; slot 0 is the
+ * aggregate line and slots 1..count-1 are cpu0..cpuN in file order.
+ */
 typedef struct {
-    uint64_t user;
-    uint64_t nice;
-    uint64_t system;
-    uint64_t idle;
-    uint64_t iowait;
-    uint64_t irq;
-    uint64_t softirq;
-    uint64_t steal;
+    int count;
+    uint64_t field[CPU_FIELD_COUNT][CPU_SLOT_STRIDE];
 } CpuSnapshot;
 
 typedef struct {
     double temp_c;
-    double cpu_usage_percent;
+    int cpu_slots;
+    double cpu_usage_percent[CPU_SLOT_STRIDE]; // [0] aggregate, [1..] per core
+    double cpu_share_percent[CPU_FIELD_COUNT][CPU_SLOT_STRIDE]; // Same slots, per column
     uint64_t mem_total_kb;
     uint64_t mem_available_kb;
     uint64_t mem_free_kb;
+    uint64_t buffers_kb;
+    uint64_t cached_kb;
+    uint64_t shmem_kb;
+    uint64_t dirty_kb;
+    uint64_t swap_total_kb;
+    uint64_t swap_free_kb;
     double uptime_sec;
+    long interval_ms;
+    uint64_t overruns; // Ticks skipped because collection missed its deadline
 } SystemState;
 
+_Static_assert(MAX_CPU_SLOTS == SYSMON_MAX_CPU_SLOTS, "binary record slot limit out of sync");
+_Static_assert(CPU_FIELD_COUNT + 1 == SYSMON_CPU_COLUMNS, "binary record columns out of sync");
+
+typedef enum {
+    FORMAT_JSON,
+    FORMAT_BINARY,
+    FORMAT_NONE     // No stdout log, e.g. shared memory only
+} OutputFormat;
+
+typedef enum {
+    FSYNC_NONE,     // Leave write-back to the kernel
+    FSYNC_DATA,     // fdatasync() after every flush
+    FSYNC_FULL      // fsync() after every flush, metadata included
+} FsyncPolicy;
+
+/* Command line configuration */
+typedef struct {
+    long interval_ms;
+    OutputFormat format;
+    int publish_shm;
+    long batch_samples;     // Samples per write; 1 writes each sample as it is taken
+    long flush_sec;         // Longest a sample may wait in the buffer, 0 for no limit
+    FsyncPolicy fsync;
+} Config;
+
+/**
+ * Write-coalescing buffer in front of stdout. Samples are appended to
+ * buf and written out together, so the log file sees one write (and one
+ * metadata update) per batch instead of per sample.
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+    off_t offset;           // File offset buf[0] will be written at, -1 if stdout is not seekable
+    long page_size;
+    long batch_samples;
+    long pending_samples;   // Samples appended since the last count-triggered flush
+    int64_t flush_ns;       // 0: no time limit
+    struct timespec oldest; // CLOCK_MONOTONIC time the oldest buffered byte was appended
+    FsyncPolicy fsync;
+} OutputSink;
+
+// Set by the shutdown signal handler; the main loop flushes and exits
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * Maps a /proc/meminfo key (including the trailing ':') to the
+ * SystemState member it is stored in. Add a row to collect a new field.
+ */
+typedef struct {
+    const char *key;
+    size_t key_len;
+    size_t offset;
+} MeminfoField;
+
+#define MEMINFO_FIELD(name, member) \
+    { name ":", sizeof(name ":") - 1, offsetof(SystemState, member) }
+
+static const MeminfoField meminfo_fields[] = {
+    MEMINFO_FIELD("MemTotal",     mem_total_kb),
+    MEMINFO_FIELD("MemFree",      mem_free_kb),
+    MEMINFO_FIELD("MemAvailable", mem_available_kb),
+    MEMINFO_FIELD("Buffers",      buffers_kb),
+    MEMINFO_FIELD("Cached",       cached_kb),
+    MEMINFO_FIELD("SwapTotal",    swap_total_kb),
+    MEMINFO_FIELD("SwapFree",     swap_free_kb),
+    MEMINFO_FIELD("Dirty",        dirty_kb),
+    MEMINFO_FIELD("Shmem",        shmem_kb),
+};
+
+#define MEMINFO_FIELD_COUNT (sizeof(meminfo_fields) / sizeof(meminfo_fields[0]))
+
+/**
+ * Kernel sources kept open for the lifetime of the collector.
+ * Each tick re-reads them with pread() at offset 0 instead of
+ * paying for open/close (and stdio buffers) on every sample.
+ */
+typedef struct {
+    int stat_fd;
+    int meminfo_fd;
+    int uptime_fd;
+    int thermal_fd;
+} SourceFiles;
+
 /* --- Helper Functions --- */
 
+/**
+ * @brief Opens all kernel sources once at startup.
+ * @param src Pointer to SourceFiles to fill. Missing sources are set to -1.
+ */
+static void open_sources(SourceFiles *src) {
+    src->stat_fd    = open(PROC_STAT_PATH, O_RDONLY | O_CLOEXEC);
+    src->meminfo_fd = open(PROC_MEMINFO_PATH, O_RDONLY | O_CLOEXEC);
+    src->uptime_fd  = open(PROC_UPTIME_PATH, O_RDONLY | O_CLOEXEC);
+    src->thermal_fd = open(THERMAL_ZONE_PATH, O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * @brief Re-reads a persistent source from the start into a NUL-terminated buffer.
+ * @return Number of bytes read, or -1 on error.
+ */
+static ssize_t read_source(int fd, char *buffer, size_t size) {
+    if (fd < 0) return -1;
+
+    ssize_t bytes_read;
+    do {
+        bytes_read = pread(fd, buffer, size - 1, 0);
+    } while (bytes_read < 0 && errno == EINTR);
+
+    if (bytes_read < 0) return -1;
+    buffer[bytes_read] = '\0';
+    return bytes_read;
+}
+
 /**
  * @brief Reads the current system uptime.
  * @return Uptime in seconds (double).
  */
-static double get_uptime(void) {
-    FILE *fp = fopen("/proc/uptime", "r");
-    if (!fp) return 0.0;
+static double get_uptime(const SourceFiles *src) {
+    char buffer[64];
+    if (read_source(src->uptime_fd, buffer, sizeof(buffer)) <= 0) return 0.0;
 
-    double uptime = 0.0;
-    if (fscanf(fp, "%lf", &uptime) != 1) {
-        uptime = 0.0;
-    }
-    fclose(fp);
-    return uptime;
+    return strtod(buffer, NULL);
 }
 
 /**
  * @brief Reads the CPU temperature from the standard thermal zone.
  * @return Temperature in Celsius.
  */
-static double get_cpu_temperature(void) {
-    int fd = open(THERMAL_ZONE_PATH, O_RDONLY);
-    if (fd < 0) {
+static double get_cpu_temperature(const SourceFiles *src) {
+    char buffer[16];
+    if (read_source(src->thermal_fd, buffer, sizeof(buffer)) <= 0) {
         // Fallback or error logging could go here
         return -1.0;
     }
 
-    char buffer[16];
-    ssize_t bytes_read = read(fd, buffer, sizeof(buffer) - 1);
-    close(fd);
-
-    if (bytes_read <= 0) return -1.0;
-
-    buffer[bytes_read] = '\0';
     int millidegrees = atoi(buffer);
     return millidegrees / 1000.0;
 }
 
 /**
- * @brief Parses /proc/meminfo for memory stats.
+ * @brief Parses the text of /proc/meminfo into SystemState.
+ *
+ * Single pass over the buffer: each line is matched against the
+ * meminfo_fields table, values are converted with an integer fast path,
+ * and the scan stops as soon as every requested field has been filled.
+ * Keys match whole, colon included, from the start of a line, so
+ * "SwapCached:" is not taken for "Cached:". Absent keys are left as they were.
+ *
  * @param state Pointer to SystemState to update.
  */
-static void get_memory_info(SystemState *state) {
-    FILE *fp = fopen(PROC_MEMINFO_PATH, "r");
-    if (!fp) return;
-
-    char line[128];
-    // Simple parser looking for specific keys
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "MemTotal:", 9) == 0) {
-            sscanf(line, "MemTotal: %lu kB", &state->mem_total_kb);
-        } else if (strncmp(line, "MemFree:", 8) == 0) {
-            sscanf(line, "MemFree: %lu kB", &state->mem_free_kb);
-        } else if (strncmp(line, "MemAvailable:", 13) == 0) {
-            sscanf(line, "MemAvailable: %lu kB", &state->mem_available_kb);
+static void parse_meminfo(const char *buffer, size_t len, SystemState *state) {
+    const uint32_t all_found = (1u << MEMINFO_FIELD_COUNT) - 1;
+    uint32_t found = 0;
+    const char *p = buffer;
+    const char *end = buffer + len;
+
+    while (p < end && found != all_found) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+
+        for (size_t i = 0; i < MEMINFO_FIELD_COUNT; i++) {
+            const MeminfoField *f = &meminfo_fields[i];
+            if ((found & (1u << i)) || p[0] != f->key[0]) continue;
+            if ((size_t)(eol - p) <= f->key_len || memcmp(p, f->key, f->key_len) != 0) continue;
+
+            const char *v = p + f->key_len;
+            while (v < eol && *v == ' ') v++;
+
+            uint64_t value = 0;
+            while (v < eol && *v >= '0' && *v <= '9') {
+                value = value * 10 + (uint64_t)(*v - '0');
+                v++;
+            }
+
+            *(uint64_t *)((char *)state + f->offset) = value;
+            found |= 1u << i;
+            break;
         }
+        p = eol + 1;
     }
-    fclose(fp);
 }
 
 /**
- * @brief Reads /proc/stat and populates a CpuSnapshot struct.
+ * @brief Reads /proc/meminfo for memory stats with one pread().
+ * @param state Pointer to SystemState to update.
+ */
+static void get_memory_info(const SourceFiles *src, SystemState *state) {
+    char buffer[MEMINFO_BUFFER_SIZE];
+    ssize_t len = read_source(src->meminfo_fd, buffer, sizeof(buffer));
+    if (len <= 0) return;
+
+    parse_meminfo(buffer, (size_t)len, state);
+}
+
+/**
+ * @brief Parses an unsigned decimal integer and advances the cursor.
+ */
+static uint64_t parse_u64(const char **cursor, const char *end) {
+    const char *p = *cursor;
+    uint64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (uint64_t)(*p - '0');
+        p++;
+    }
+    *cursor = p;
+    return value;
+}
+
+/**
+ * @brief Reads every cpu line of /proc/stat into a CpuSnapshot.
  * @param snapshot Pointer to the snapshot struct to fill.
  * @return 0 on success, -1 on error.
  */
-static int get_cpu_snapshot(CpuSnapshot *snapshot) {
-    FILE *fp = fopen(PROC_STAT_PATH, "r");
-    if (!fp) return -1;
+static int get_cpu_snapshot(const SourceFiles *src, CpuSnapshot *snapshot) {
+    static char buffer[STAT_BUFFER_SIZE];
+    ssize_t len = read_source(src->stat_fd, buffer, sizeof(buffer));
+    if (len <= 0) return -1;
 
-    char buffer[BUFFER_SIZE];
-    if (!fgets(buffer, sizeof(buffer), fp)) {
-        fclose(fp);
-        return -1;
-    }
-    fclose(fp);
+    // Format: cpuN user nice system idle iowait irq softirq steal guest guest_nice
+    // The cpu lines always come first, aggregate line before the per-core ones.
+    const char *p = buffer;
+    const char *end = buffer + len;
+    int slot = 0;
 
-    // Parsing the first line: "cpu  ..."
-    // Format: cpu  user nice system idle iowait irq softirq steal guest guest_nice
-    int ret = sscanf(buffer, "cpu  %lu %lu %lu %lu %lu %lu %lu %lu",
-                     &snapshot->user, &snapshot->nice, &snapshot->system,
-                     &snapshot->idle, &snapshot->iowait, &snapshot->irq,
-                     &snapshot->softirq, &snapshot->steal);
+    while (slot < MAX_CPU_SLOTS && end - p > 3 && memcmp(p, "cpu", 3) == 0) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) break; // Truncated line
 
-    if (ret < 8) {
-        // Handle older kernels or missing steal field
-        snapshot->steal = 0;
+        p += 3;
+        while (p < eol && *p != ' ') p++; // Skip the core id
+
+        for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+            while (p < eol && *p == ' ') p++;
+            // Older kernels lack the trailing columns
+            snapshot->field[f][slot] = parse_u64(&p, eol);
+        }
+        slot++;
+        p = eol + 1;
     }
+
+    if (slot == 0) return -1;
+    snapshot->count = slot;
     return 0;
 }
 
 /**
- * @brief Calculates CPU usage percentage between two snapshots.
+ * @brief Calculates CPU usage and its per-column breakdown for every slot.
+ *
+ * Each pass walks contiguous slot arrays of whole columns, so every inner
+ * loop is a straight run over curr->field[f][], prev->field[f][] and
+ * share[f][] that GCC vectorizes at -O2 and -O3 (checked with
+ * -fopt-info-vec). The slot count is rounded up to whole vectors, which
+ * the padded arrays have room for, so no scalar tail is left over. A
+ * counter that went down since the previous snapshot contributes 0.
+ * guest and guest_nice are already included in user and nice by the
+ * kernel, so they are reported as shares but not added to the total again.
+ *
+ * Deltas are narrowed to 32 bits, which convert to double in vector
+ * registers on SSE2 and NEON alike: one interval is far below 2^32
+ * ticks (256 cores for an hour at USER_HZ 100 is about 9.2e7).
+ *
  * @param prev Previous snapshot.
  * @param curr Current snapshot.
- * @return Usage percentage (0.0 - 100.0).
+ * @param usage Output busy percentage (0.0 - 100.0), one per slot.
+ * @param share Output percentage of the interval spent in each column, per slot.
+ * @param count Number of slots to compute; slots up to the next multiple of CPU_SLOT_VECTOR are overwritten.
+ */
+static void calculate_cpu_usage(const CpuSnapshot *restrict prev, const CpuSnapshot *restrict curr,
+                                double *restrict usage,
+                                double (*restrict share)[CPU_SLOT_STRIDE], int count) {
+    const int n = (count + CPU_SLOT_VECTOR - 1) & ~(CPU_SLOT_VECTOR - 1);
+
+    // Ticks spent in each column, held in share until the totals are known
+    for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+        const uint64_t *restrict c = curr->field[f];
+        const uint64_t *restrict p = prev->field[f];
+        double *restrict d = share[f];
+        for (int i = 0; i < n; i++) {
+            // Counters can step backwards (per-CPU iowait does): count that as no time, not a wrap
+            uint64_t diff = c[i] - p[i];
+            d[i] = (double)(uint32_t)(diff & ((diff >> 63) - 1));
+        }
+    }
+
+    double scale[CPU_SLOT_STRIDE];
+    for (int i = 0; i < n; i++) {
+        double busy = share[CPU_USER][i] + share[CPU_NICE][i] + share[CPU_SYSTEM][i] +
+                      share[CPU_IRQ][i] + share[CPU_SOFTIRQ][i] + share[CPU_STEAL][i];
+        double total = busy + share[CPU_IDLE][i] + share[CPU_IOWAIT][i];
+
+        // Every delta is 0 whenever total is 0, so scaling by 1 yields 0.0
+        scale[i] = 100.0 / (total + (total == 0.0));
+        usage[i] = busy * scale[i];
+    }
+
+    for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+        double *restrict s = share[f];
+        for (int i = 0; i < n; i++) s[i] *= scale[i];
+    }
+}
+
+/**
+ * @brief Appends formatted text to a JSON buffer, clamping on overflow.
+ */
+static void json_append(char *buffer, size_t size, size_t *len, const char *fmt, ...) {
+    if (*len >= size) return;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer + *len, size - *len, fmt, args);
+    va_end(args);
+
+    if (n > 0) *len = ((size_t)n < size - *len) ? *len + (size_t)n : size;
+}
+
+/**
+ * @brief Writes a complete buffer to stdout, exiting on failure.
+ */
+static void write_output(const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // Error writing to stdout (e.g., broken pipe if piped to another tool)
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * @brief Sets up the output sink for stdout.
+ * @return 0 on success, -1 if the buffer could not be allocated.
+ */
+static int sink_init(OutputSink *sink, const Config *config) {
+    memset(sink, 0, sizeof(*sink));
+    sink->page_size = sysconf(_SC_PAGESIZE);
+    if (sink->page_size <= 0) sink->page_size = 4096;
+
+    // Page-aligned memory, so a page of the buffer is a page of the file
+    void *buf;
+    if (posix_memalign(&buf, (size_t)sink->page_size, SINK_BUFFER_SIZE) != 0) return -1;
+    sink->buf = buf;
+    sink->size = SINK_BUFFER_SIZE;
+    sink->offset = lseek(STDOUT_FILENO, 0, SEEK_END);
+    sink->batch_samples = config->batch_samples;
+    sink->flush_ns = (int64_t)config->flush_sec * NSEC_PER_SEC;
+    sink->fsync = config->fsync;
+    return 0;
+}
+
+/**
+ * @brief Writes the first len buffered bytes in one write() and keeps the rest.
+ */
+static void sink_write(OutputSink *sink, size_t len) {
+    if (len == 0) return;
+
+    write_output(sink->buf, len);
+    if (sink->offset >= 0) sink->offset += (off_t)len;
+    sink->len -= len;
+    memmove(sink->buf, sink->buf + len, sink->len);
+
+    if (sink->fsync == FSYNC_NONE) return;
+    int rc = (sink->fsync == FSYNC_DATA) ? fdatasync(STDOUT_FILENO) : fsync(STDOUT_FILENO);
+    // EINVAL: stdout cannot be synced at all (a pipe, /dev/null); anything else lost data
+    if (rc != 0 && errno != EINVAL) {
+        perror(sink->fsync == FSYNC_DATA ? "fdatasync" : "fsync");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Flushes the buffer.
+ *
+ * Unless everything is required, a batch that crosses a page boundary of
+ * the file is written up to the last boundary and the partial page waits
+ * for the next batch, so appends never rewrite the tail of a page already
+ * written. A batch that stays within one page is written in full. Readers
+ * of the log already skip an incomplete trailing record.
+ *
+ * @param all Write everything buffered (time limit, full buffer, shutdown).
+ */
+static void sink_flush(OutputSink *sink, int all) {
+    size_t len = sink->len;
+    if (!all && sink->offset >= 0) {
+        off_t end = (sink->offset + (off_t)len) / sink->page_size * sink->page_size;
+        if (end > sink->offset) len = (size_t)(end - sink->offset);
+    }
+    sink_write(sink, len);
+    sink->pending_samples = 0;
+    if (sink->len > 0) return; // The carried-over bytes keep their original age
+    sink->oldest.tv_sec = 0;
+    sink->oldest.tv_nsec = 0;
+}
+
+/**
+ * @brief Appends one sample to the sink and flushes when the batch is
+ *        complete or the oldest buffered sample reached the time limit.
+ */
+static void sink_append(OutputSink *sink, const void *data, size_t len) {
+    if (len > sink->size - sink->len) sink_flush(sink, 1);
+    if (len > sink->size) {
+        write_output(data, len); // Larger than any batch: bypass the buffer
+        if (sink->offset >= 0) sink->offset += (off_t)len;
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (sink->len == 0) sink->oldest = now;
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+    sink->pending_samples++;
+
+    int64_t age_ns = (int64_t)(now.tv_sec - sink->oldest.tv_sec) * NSEC_PER_SEC +
+                     (now.tv_nsec - sink->oldest.tv_nsec);
+    if (sink->batch_samples <= 1) {
+        sink_flush(sink, 1); // Not batching: every sample goes out as it is taken
+    } else if (sink->flush_ns > 0 && age_ns >= sink->flush_ns) {
+        sink_flush(sink, 1);
+    } else if (sink->pending_samples >= sink->batch_samples) {
+        sink_flush(sink, 0);
+    }
+}
+
+/**
+ * @brief Records a shutdown request; the main loop flushes and exits.
+ */
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double memory_used_pct(const SystemState *state) {
+    return (state->mem_total_kb > 0) ?
+        (1.0 - ((double)state->mem_available_kb / state->mem_total_kb)) * 100.0 : 0.0;
+}
+
+/**
+ * @brief Converts a percentage to the binary record's tenths-of-a-percent encoding.
  */
-static double calculate_cpu_usage(const CpuSnapshot *prev, const CpuSnapshot *curr) {
-    uint64_t prev_idle = prev->idle + prev->iowait;
-    uint64_t curr_idle = curr->idle + curr->iowait;
+static uint16_t pct_x10(double pct) {
+    if (pct < 0.0) return SYSMON_PCT_NA;
+    if (pct > 100.0) pct = 100.0;
+    return (uint16_t)(pct * 10.0 + 0.5);
+}
 
-    uint64_t prev_non_idle = prev->user + prev->nice + prev->system + prev->irq + prev->softirq + prev->steal;
-    uint64_t curr_non_idle = curr->user + curr->nice + curr->system + curr->irq + curr->softirq + curr->steal;
+/**
+ * @brief Prepares the binary log header, or validates the one already in stdout.
+ *
+ * When stdout is appended to an existing binary log, the header is kept
+ * as long as the record layout matches; otherwise a new header is written.
+ *
+ * @param header Header to fill.
+ * @param cpu_slots Slots reserved per record.
+ * @return 0 on success, -1 if stdout holds an incompatible log.
+ */
+static int begin_binary_log(SysmonLogHeader *header, int cpu_slots) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SYSMON_LOG_MAGIC, SYSMON_LOG_MAGIC_LEN);
+    header->version = SYSMON_LOG_VERSION;
+    header->header_size = sizeof(SysmonLogHeader);
+    header->cpu_slots = (uint16_t)cpu_slots;
+    header->cpu_columns = SYSMON_CPU_COLUMNS;
+    header->record_size = sysmon_record_size((unsigned)cpu_slots);
 
-    uint64_t prev_total = prev_idle + prev_non_idle;
-    uint64_t curr_total = curr_idle + curr_non_idle;
+    off_t size = lseek(STDOUT_FILENO, 0, SEEK_END);
+    if (size > 0) {
+        // stdout is usually write-only, so read the header back through a second descriptor
+        SysmonLogHeader existing;
+        int fd = open("/proc/self/fd/1", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        ssize_t n = pread(fd, &existing, sizeof(existing), 0);
+        close(fd);
 
-    uint64_t total_diff = curr_total - prev_total;
-    uint64_t idle_diff  = curr_idle - prev_idle;
+        if (n != (ssize_t)sizeof(existing) || memcmp(&existing, header, sizeof(existing)) != 0) {
+            return -1;
+        }
 
-    if (total_diff == 0) return 0.0;
+        // A record torn by a crash would shift every later one: pad up to the next record boundary
+        off_t torn = (size - header->header_size) % header->record_size;
+        if (torn > 0) {
+            static const char zeros[SYSMON_MAX_RECORD_SIZE];
+            write_output(zeros, (size_t)(header->record_size - torn));
+        }
+        return 0;
+    }
 
-    return (double)(total_diff - idle_diff) / total_diff * 100.0;
+    write_output(header, sizeof(*header));
+    return 0;
+}
+
+/**
+ * @brief Creates (or reattaches to) the shared-memory ring for records of the given size.
+ *
+ * A ring left by a previous run that did not exit cleanly (a clean exit
+ * unlinks it) is reused if it has the same layout, so its sequence keeps
+ * increasing for readers that already have it mapped.
+ *
+ * @return Mapped ring, or NULL on error.
+ */
+static SysmonRing *open_shm_ring(uint32_t record_size) {
+    uint32_t slot_size = sysmon_ring_slot_size(record_size);
+    size_t size = sysmon_ring_size(SYSMON_RING_CAPACITY, slot_size);
+
+    int fd = shm_open(SYSMON_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    SysmonRing *ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) return NULL;
+
+    if (memcmp(ring->magic, SYSMON_RING_MAGIC, SYSMON_LOG_MAGIC_LEN) != 0 ||
+        ring->version != SYSMON_RING_VERSION || ring->capacity != SYSMON_RING_CAPACITY ||
+        ring->record_size != record_size || ring->slot_size != slot_size) {
+        memset(ring, 0, size);
+        ring->version = SYSMON_RING_VERSION;
+        ring->capacity = SYSMON_RING_CAPACITY;
+        ring->record_size = record_size;
+        ring->slot_size = slot_size;
+        atomic_thread_fence(memory_order_release);
+        memcpy(ring->magic, SYSMON_RING_MAGIC, SYSMON_LOG_MAGIC_LEN);
+    }
+    return ring;
+}
+
+/**
+ * @brief Encodes the system state as one fixed-size binary record.
+ * @param cpu_slots CPU slots reserved in the record layout.
+ * @param record_size Size of the record buffer.
+ * @param record Scratch buffer, reused across calls.
+ */
+static void fill_binary_record(const SystemState *state, int cpu_slots, uint32_t record_size,
+                               SysmonRecord *record) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memset(record, 0, record_size);
+    record->timestamp_ns = (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+    record->uptime_sec = state->uptime_sec;
+    record->temp_c = state->temp_c;
+    record->overruns = state->overruns;
+    record->interval_ms = (uint32_t)state->interval_ms;
+    record->mem_used_pct_x10 = pct_x10(memory_used_pct(state));
+    record->mem_total_kb = state->mem_total_kb;
+    record->mem_free_kb = state->mem_free_kb;
+    record->mem_available_kb = state->mem_available_kb;
+    record->buffers_kb = state->buffers_kb;
+    record->cached_kb = state->cached_kb;
+    record->shmem_kb = state->shmem_kb;
+    record->dirty_kb = state->dirty_kb;
+    record->swap_total_kb = state->swap_total_kb;
+    record->swap_free_kb = state->swap_free_kb;
+
+    int slots = (state->cpu_slots < cpu_slots) ? state->cpu_slots : cpu_slots;
+    record->cpu_slots = (uint16_t)slots;
+    for (int i = 0; i < slots; i++) {
+        uint16_t *col = &record->cpu[i * SYSMON_CPU_COLUMNS];
+        col[0] = pct_x10(state->cpu_usage_percent[i]);
+        for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+            col[f + 1] = pct_x10(state->cpu_share_percent[f][i]);
+        }
+    }
+    sysmon_record_seal(record, record_size);
 }
 
 /**
  * @brief Prints the system state as a compact JSON object.
  */
-static void print_json(const SystemState *state) {
+static void print_json(const SystemState *state, OutputSink *sink) {
     char json_buffer[JSON_BUFFER_SIZE];
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
 
-    int len = snprintf(json_buffer, JSON_BUFFER_SIZE,
+    size_t len = 0;
+    json_append(json_buffer, JSON_BUFFER_SIZE, &len,
         "{"
-        "\"timestamp\":%ld.%09ld,"
+        "\"timestamp\":%lld.%09ld,"
         "\"uptime_sec\":%.2f,"
+        "\"interval_ms\":%ld,"
+        "\"overruns\":%" PRIu64 ","
         "\"cpu\":{"
             "\"temp_c\":%.2f,"
-            "\"usage_pct\":%.1f"
-        "},"
-        "\"memory\":{"
-            "\"total_kb\":%lu,"
-            "\"free_kb\":%lu,"
-            "\"available_kb\":%lu,"
-            "\"used_pct\":%.1f"
-        "}"
-        "}\n",
-        ts.tv_sec, ts.tv_nsec,
+            "\"usage_pct\":%.1f,"
+            "\"per_core_pct\":[",
+        (long long)ts.tv_sec, ts.tv_nsec,
         state->uptime_sec,
+        state->interval_ms,
+        state->overruns,
         state->temp_c,
-        state->cpu_usage_percent,
+        state->cpu_usage_percent[0]);
+
+    for (int i = 1; i < state->cpu_slots; i++) {
+        json_append(json_buffer, JSON_BUFFER_SIZE, &len, (i > 1) ? ",%.1f" : "%.1f",
+                    state->cpu_usage_percent[i]);
+    }
+
+    // Aggregate breakdown: "breakdown_pct":{"user":..,"system":..,...}
+    json_append(json_buffer, JSON_BUFFER_SIZE, &len, "],\"breakdown_pct\":{");
+    for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+        json_append(json_buffer, JSON_BUFFER_SIZE, &len, "%s\"%s\":%.1f",
+                    (f > 0) ? "," : "", sysmon_cpu_field_names[f], state->cpu_share_percent[f][0]);
+    }
+
+    // Per-core breakdown, one array per column: "per_core_breakdown_pct":{"user":[..],...}
+    json_append(json_buffer, JSON_BUFFER_SIZE, &len, "},\"per_core_breakdown_pct\":{");
+    for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+        json_append(json_buffer, JSON_BUFFER_SIZE, &len, "%s\"%s\":[",
+                    (f > 0) ? "," : "", sysmon_cpu_field_names[f]);
+        for (int i = 1; i < state->cpu_slots; i++) {
+            json_append(json_buffer, JSON_BUFFER_SIZE, &len, (i > 1) ? ",%.1f" : "%.1f",
+                        state->cpu_share_percent[f][i]);
+        }
+        json_append(json_buffer, JSON_BUFFER_SIZE, &len, "]");
+    }
+
+    json_append(json_buffer, JSON_BUFFER_SIZE, &len,
+        "}},"
+        "\"memory\":{"
+            "\"total_kb\":%" PRIu64 ","
+            "\"free_kb\":%" PRIu64 ","
+            "\"available_kb\":%" PRIu64 ","
+            "\"buffers_kb\":%" PRIu64 ","
+            "\"cached_kb\":%" PRIu64 ","
+            "\"shmem_kb\":%" PRIu64 ","
+            "\"dirty_kb\":%" PRIu64 ","
+            "\"swap_total_kb\":%" PRIu64 ","
+            "\"swap_free_kb\":%" PRIu64 ","
+            "\"used_pct\":%.1f"
+        "}",
         state->mem_total_kb,
         state->mem_free_kb,
         state->mem_available_kb,
-        (state->mem_total_kb > 0) ? 
-            (1.0 - ((double)state->mem_available_kb / state->mem_total_kb)) * 100.0 : 0.0
+        state->buffers_kb,
+        state->cached_kb,
+        state->shmem_kb,
+        state->dirty_kb,
+        state->swap_total_kb,
+        state->swap_free_kb,
+        memory_used_pct(state)
     );
 
-    if (len > 0) {
-        if (write(STDOUT_FILENO, json_buffer, len) < 0) {
-            // Error writing to stdout (e.g., broken pipe if piped to another tool)
-            exit(EXIT_FAILURE);
+    // Length and checksum of everything so far, closing the object
+    size_t checked = len;
+    if (len < JSON_BUFFER_SIZE) {
+        json_append(json_buffer, JSON_BUFFER_SIZE, &len, SYSMON_JSON_LEN_KEY "%zu" SYSMON_JSON_CRC_KEY "%08x\"}\n",
+                    checked, sysmon_crc32c(json_buffer, checked));
+    }
+
+    if (len >= JSON_BUFFER_SIZE) {
+        fprintf(stderr, "JSON record truncated, dropping sample\n");
+        return;
+    }
+
+    sink_append(sink, json_buffer, len);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--interval MS] [--format json|binary|none] [--shm]\n"
+        "          [--batch N] [--flush-sec SEC] [--fsync none|data|full]\n"
+        "  -i, --interval MS   Sampling interval in milliseconds (%d-%ld, default %d)\n"
+        "  -f, --format FMT    Output JSON lines (default), fixed-size binary records or nothing\n"
+        "      --shm           Publish every sample to the shared-memory ring " SYSMON_SHM_NAME "\n"
+        "  -b, --batch N       Write the log every N samples (1-%d, default 1)\n"
+        "      --flush-sec SEC Write everything buffered once a sample is SEC seconds old (0-%d, default 0: no limit)\n"
+        "      --fsync POLICY  After each write: none (default), data (fdatasync) or full (fsync)\n"
+        "Batching implies --shm so readers still get every sample live.\n",
+        prog, MIN_INTERVAL_MS, MAX_INTERVAL_MS, DEFAULT_INTERVAL_MS, MAX_BATCH_SAMPLES, MAX_FLUSH_SEC);
+}
+
+/**
+ * @brief Matches "--name=value", "--name value" or "-n value" at argv[*i].
+ * @param short_name The "-n" form, or NULL if the option has none.
+ * @return Pointer to the value, or NULL if argv[*i] is a different option.
+ */
+static const char *option_value(int argc, char **argv, int *i, const char *name, const char *short_name) {
+    size_t name_len = strlen(name);
+
+    if (strncmp(argv[*i], name, name_len) == 0 && argv[*i][name_len] == '=') {
+        return argv[*i] + name_len + 1;
+    }
+    if (strcmp(argv[*i], name) == 0 || (short_name && strcmp(argv[*i], short_name) == 0)) {
+        if (*i + 1 >= argc) return NULL;
+        return argv[++(*i)];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses a whole decimal number within [min, max].
+ * @return 0 on success, -1 if value is not such a number.
+ */
+static int parse_long(const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (errno || end == value || *end != '\0' || n < min || n > max) return -1;
+    *out = n;
+    return 0;
+}
+
+/**
+ * @brief Parses command line options into a Config.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+static int parse_args(int argc, char **argv, Config *config) {
+    config->interval_ms = DEFAULT_INTERVAL_MS;
+    config->format = FORMAT_JSON;
+    config->publish_shm = 0;
+    config->batch_samples = 1;
+    config->flush_sec = 0;
+    config->fsync = FSYNC_NONE;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = NULL;
+
+        if (strcmp(argv[i], "--shm") == 0) {
+            config->publish_shm = 1;
+        } else if ((value = option_value(argc, argv, &i, "--interval", "-i"))) {
+            if (parse_long(value, MIN_INTERVAL_MS, MAX_INTERVAL_MS, &config->interval_ms) != 0) return -1;
+        } else if ((value = option_value(argc, argv, &i, "--batch", "-b"))) {
+            if (parse_long(value, 1, MAX_BATCH_SAMPLES, &config->batch_samples) != 0) return -1;
+        } else if ((value = option_value(argc, argv, &i, "--flush-sec", NULL))) {
+            if (parse_long(value, 0, MAX_FLUSH_SEC, &config->flush_sec) != 0) return -1;
+        } else if ((value = option_value(argc, argv, &i, "--fsync", NULL))) {
+            if (strcmp(value, "none") == 0) {
+                config->fsync = FSYNC_NONE;
+            } else if (strcmp(value, "data") == 0) {
+                config->fsync = FSYNC_DATA;
+            } else if (strcmp(value, "full") == 0) {
+                config->fsync = FSYNC_FULL;
+            } else {
+                return -1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--format", "-f"))) {
+            if (strcmp(value, "json") == 0) {
+                config->format = FORMAT_JSON;
+            } else if (strcmp(value, "binary") == 0) {
+                config->format = FORMAT_BINARY;
+            } else if (strcmp(value, "none") == 0) {
+                config->format = FORMAT_NONE;
+            } else {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+
+    // The batched log lags behind; shared memory keeps the live view current
+    if (config->batch_samples > 1 || config->flush_sec > 0) config->publish_shm = 1;
+    return 0;
+}
+
+/**
+ * @brief Advances an absolute deadline by the given number of nanoseconds.
+ */
+static void timespec_add_ns(struct timespec *ts, int64_t ns) {
+    ts->tv_sec += ns / NSEC_PER_SEC;
+    ts->tv_nsec += ns % NSEC_PER_SEC;
+    if (ts->tv_nsec >= NSEC_PER_SEC) {
+        ts->tv_sec++;
+        ts->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+/**
+ * @brief Reports when the oldest buffered sample reaches the --flush-sec limit.
+ * @return 1 with the CLOCK_MONOTONIC time in due, 0 if nothing is waiting on a time limit.
+ */
+static int sink_flush_due(const OutputSink *sink, struct timespec *due) {
+    if (sink->flush_ns == 0 || sink->len == 0) return 0;
+    *due = sink->oldest;
+    timespec_add_ns(due, sink->flush_ns);
+    return 1;
+}
+
+/**
+ * @brief Sleeps until the next tick on an absolute CLOCK_MONOTONIC schedule.
+ *
+ * Deadlines are advanced by whole periods so the schedule never drifts.
+ * If collection overran one or more deadlines, those ticks are skipped
+ * and counted instead of stretching the period. A --flush-sec limit that
+ * expires before the tick is enforced here, so an interval longer than
+ * the limit cannot hold buffered samples back.
+ *
+ * @param deadline Next absolute deadline, updated in place.
+ * @param period_ns Sampling period in nanoseconds.
+ * @param sink Output sink whose time limit is enforced while sleeping.
+ * @return Number of deadlines that were missed.
+ */
+static uint64_t wait_next_tick(struct timespec *deadline, int64_t period_ns, OutputSink *sink) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t missed = 0;
+    int64_t late_ns = (int64_t)(now.tv_sec - deadline->tv_sec) * NSEC_PER_SEC +
+                      (now.tv_nsec - deadline->tv_nsec);
+    if (late_ns > 0) {
+        missed = (uint64_t)(late_ns / period_ns) + 1;
+        timespec_add_ns(deadline, (int64_t)missed * period_ns);
+    }
+
+    while (!stop_requested) {
+        struct timespec wake = *deadline;
+        int flush_first = sink_flush_due(sink, &wake) &&
+                          (wake.tv_sec < deadline->tv_sec ||
+                           (wake.tv_sec == deadline->tv_sec && wake.tv_nsec < deadline->tv_nsec));
+        if (!flush_first) wake = *deadline;
+
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+            continue; // Restart with the same absolute deadline
         }
+        if (!flush_first) break;
+        sink_flush(sink, 1);
     }
+
+    timespec_add_ns(deadline, period_ns);
+    return missed;
 }
 
-int main(void) {
-    SystemState current_state = {0};
-    CpuSnapshot prev_cpu_snap, curr_cpu_snap;
+int main(int argc, char **argv) {
+    static SystemState current_state;
+    static CpuSnapshot cpu_snaps[2];
+    CpuSnapshot *prev_cpu_snap = &cpu_snaps[0];
+    CpuSnapshot *curr_cpu_snap = &cpu_snaps[1];
+    SourceFiles sources;
+    Config config;
+
+    if (parse_args(argc, argv, &config) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    sysmon_crc32c_init();
+    current_state.interval_ms = config.interval_ms;
+
+    open_sources(&sources);
 
     // Initial snapshot
-    if (get_cpu_snapshot(&prev_cpu_snap) != 0) {
+    if (get_cpu_snapshot(&sources, prev_cpu_snap) != 0) {
         fprintf(stderr, "Failed to read %s\n", PROC_STAT_PATH);
         return EXIT_FAILURE;
     }
 
-    // Unbuffered output for real-time piping
+    // stdout is only written through the sink (and the binary header)
     setvbuf(stdout, NULL, _IONBF, 0);
 
-    while (1) {
-        // Sleep for 1 second between updates
-        sleep(1);
+    // Shutdown signals end the loop so buffered samples are flushed, not lost
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = handle_stop_signal;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    sigaction(SIGHUP, &stop_action, NULL);
+
+    // Binary log and shared-memory ring share one record layout and buffer
+    const int record_slots = prev_cpu_snap->count;
+    const uint32_t record_size = sysmon_record_size((unsigned)record_slots);
+    SysmonRecord *record = malloc(record_size);
+    if (!record) return EXIT_FAILURE;
+
+    SysmonLogHeader log_header;
+    if (config.format == FORMAT_BINARY && begin_binary_log(&log_header, record_slots) != 0) {
+        fprintf(stderr, "stdout holds an incompatible binary log\n");
+        return EXIT_FAILURE;
+    }
+
+    OutputSink sink;
+    if (sink_init(&sink, &config) != 0) return EXIT_FAILURE;
+
+    SysmonRing *ring = NULL;
+    if (config.publish_shm && !(ring = open_shm_ring(record_size))) {
+        perror("shm " SYSMON_SHM_NAME);
+        return EXIT_FAILURE;
+    }
+
+    const int64_t period_ns = (int64_t)config.interval_ms * NSEC_PER_MSEC;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timespec_add_ns(&deadline, period_ns);
+
+    while (!stop_requested) {
+        // Sleep until the next absolute deadline
+        current_state.overruns += wait_next_tick(&deadline, period_ns, &sink);
+        if (stop_requested) break;
 
         // Update CPU Snapshot
-        if (get_cpu_snapshot(&curr_cpu_snap) == 0) {
-            current_state.cpu_usage_percent = calculate_cpu_usage(&prev_cpu_snap, &curr_cpu_snap);
+        if (get_cpu_snapshot(&sources, curr_cpu_snap) == 0) {
+            // A core was hotplugged: per-core slots no longer line up, keep the aggregate only
+            int slots = (curr_cpu_snap->count == prev_cpu_snap->count) ? curr_cpu_snap->count : 1;
+            calculate_cpu_usage(prev_cpu_snap, curr_cpu_snap, current_state.cpu_usage_percent,
+                                current_state.cpu_share_percent, slots);
+            current_state.cpu_slots = slots;
+
             // Save current as previous for next iteration
+            CpuSnapshot *tmp = prev_cpu_snap;
             prev_cpu_snap = curr_cpu_snap;
+            curr_cpu_snap = tmp;
         } else {
-            current_state.cpu_usage_percent = -1.0;
+            current_state.cpu_usage_percent[0] = -1.0;
+            for (int f = 0; f < CPU_FIELD_COUNT; f++) current_state.cpu_share_percent[f][0] = -1.0;
+            current_state.cpu_slots = 1;
         }
 
         // Update other metrics
-        current_state.temp_c = get_cpu_temperature();
-        current_state.uptime_sec = get_uptime();
-        get_memory_info(&current_state);
+        current_state.temp_c = get_cpu_temperature(&sources);
+        current_state.uptime_sec = get_uptime(&sources);
+        get_memory_info(&sources, &current_state);
 
         // Output
-        print_json(&current_state);
+        if (config.format == FORMAT_BINARY || ring) {
+            fill_binary_record(&current_state, record_slots, record_size, record);
+        }
+        if (ring) {
+            sysmon_ring_publish(ring, record);
+        }
+        if (config.format == FORMAT_BINARY) {
+            sink_append(&sink, record, record_size);
+        } else if (config.format == FORMAT_JSON) {
+            print_json(&current_state, &sink);
+        }
     }
 
+    sink_flush(&sink, 1);
+    // A ring nobody writes to any more would only mislead readers
+    if (ring) shm_unlink(SYSMON_SHM_NAME);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,330 @@
+/**
+ * sysmon_record.h
+ *
+ * Binary log format shared by sysmon (writer) and monitor_server (reader).
+ *
+ * A binary log is one SysmonLogHeader followed by fixed-size records of
+ * header.record_size bytes each. Sample i starts at
+ * header.header_size + i * header.record_size, so the newest complete
+ * sample is a single pread() at the last record boundary.
+ *
+ * The same records are published live through a POSIX shared-memory
+ * ring (SysmonRing) so readers can take the latest sample without any
+ * syscalls.
+ *
+ * Every log record carries its length and a CRC32C, so a record torn by a
+ * power cut is recognised in O(1) and skipped. Binary records start with
+ * both; JSON lines end in ,"len":N,"crc32c":"xxxxxxxx"} where N is the
+ * length of the checked text before ,"len": -- counted back from the
+ * newline, it also finds where the record starts when a torn line got
+ * glued in front of it.
+ *
+ * All fields are native-endian (little-endian on every Raspberry Pi).
+ */
+
+#ifndef SYSMON_RECORD_H
+#define SYSMON_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
+#define SYSMON_LOG_MAGIC      "SYSMONB\n"
+#define SYSMON_LOG_MAGIC_LEN  8
+#define SYSMON_LOG_VERSION    2
+
+// Per-slot CPU columns: busy, then user nice system idle iowait irq softirq steal guest guest_nice
+#define SYSMON_CPU_COLUMNS    11
+#define SYSMON_MAX_CPU_SLOTS  257
+#define SYSMON_PCT_NA         0xFFFF // Percentage unavailable for this sample
+
+// JSON names of the /proc/stat columns, i.e. CPU columns 1..SYSMON_CPU_COLUMNS-1
+static const char *const sysmon_cpu_field_names[SYSMON_CPU_COLUMNS - 1] = {
+    "user", "nice", "system", "idle", "iowait",
+    "irq", "softirq", "steal", "guest", "guest_nice"
+};
+
+typedef struct {
+    char magic[SYSMON_LOG_MAGIC_LEN];
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t cpu_slots;     // Slots reserved in every record (aggregate + cores)
+    uint16_t cpu_columns;
+    uint32_t record_size;
+    uint32_t reserved;
+} SysmonLogHeader;
+
+typedef struct {
+    uint32_t length;        // record_size of the log; anything else is not a record
+    uint32_t crc32c;        // CRC32C of the record from timestamp_ns to record_size
+    int64_t timestamp_ns;   // CLOCK_REALTIME
+    double uptime_sec;
+    double temp_c;          // -1.0 if no thermal zone
+    uint64_t overruns;
+    uint32_t interval_ms;
+    uint16_t cpu_slots;     // Valid slots in this sample, <= header cpu_slots
+    uint16_t mem_used_pct_x10;
+    uint64_t mem_total_kb;
+    uint64_t mem_free_kb;
+    uint64_t mem_available_kb;
+    uint64_t buffers_kb;
+    uint64_t cached_kb;
+    uint64_t shmem_kb;
+    uint64_t dirty_kb;
+    uint64_t swap_total_kb;
+    uint64_t swap_free_kb;
+    // cpu[slot * SYSMON_CPU_COLUMNS + column], tenths of a percent; slot 0 is the aggregate
+    uint16_t cpu[];
+} SysmonRecord;
+
+_Static_assert(sizeof(SysmonLogHeader) == 24, "SysmonLogHeader layout changed");
+_Static_assert(sizeof(SysmonRecord) == 120, "SysmonRecord layout changed");
+
+#define SYSMON_RECORD_CRC_START offsetof(SysmonRecord, timestamp_ns)
+
+/**
+ * @brief Size of one record holding the given number of CPU slots, padded to 8 bytes.
+ */
+static inline uint32_t sysmon_record_size(unsigned cpu_slots) {
+    size_t size = sizeof(SysmonRecord) + (size_t)cpu_slots * SYSMON_CPU_COLUMNS * sizeof(uint16_t);
+    return (uint32_t)((size + 7) & ~(size_t)7);
+}
+
+#define SYSMON_MAX_RECORD_SIZE (sizeof(SysmonRecord) + SYSMON_MAX_CPU_SLOTS * SYSMON_CPU_COLUMNS * 2 + 8)
+
+/* --- CRC32C (Castagnoli) --- */
+
+typedef uint32_t (*SysmonCrc32cFn)(uint32_t crc, const void *data, size_t len);
+
+static uint32_t sysmon_crc32c_table[256];
+
+static inline uint32_t sysmon_crc32c_sw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len--) crc = sysmon_crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static inline uint32_t sysmon_crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+#if defined(__x86_64__)
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = (uint32_t)_mm_crc32_u64(crc, v);
+    }
+#endif
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = _mm_crc32_u32(crc, v);
+    }
+    for (; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static inline uint32_t sysmon_crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+    for (; len > 0; p++, len--) crc = __crc32cb(crc, *p);
+    return crc;
+}
+#endif
+
+static SysmonCrc32cFn sysmon_crc32c_update = sysmon_crc32c_sw;
+
+/**
+ * @brief Builds the CRC32C table and picks the CPU's CRC instructions
+ *        (SSE4.2 on x86, the ARMv8 CRC extension on 64-bit ARM) when present.
+ *        Call once at startup, before any other thread runs.
+ */
+static inline void sysmon_crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        sysmon_crc32c_table[i] = crc;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) sysmon_crc32c_update = sysmon_crc32c_hw;
+#elif defined(__aarch64__) && defined(HWCAP_CRC32)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) sysmon_crc32c_update = sysmon_crc32c_hw;
+#endif
+}
+
+static inline uint32_t sysmon_crc32c(const void *data, size_t len) {
+    return ~sysmon_crc32c_update(~0u, data, len);
+}
+
+/**
+ * @brief Fills in a record's length and checksum once its fields are set.
+ */
+static inline void sysmon_record_seal(SysmonRecord *record, uint32_t record_size) {
+    record->length = record_size;
+    record->crc32c = sysmon_crc32c((const char *)record + SYSMON_RECORD_CRC_START,
+                                   record_size - SYSMON_RECORD_CRC_START);
+}
+
+/**
+ * @brief Whether a record read from a log is whole and undamaged.
+ */
+static inline int sysmon_record_valid(const SysmonRecord *record, uint32_t record_size) {
+    return record->length == record_size &&
+           record->crc32c == sysmon_crc32c((const char *)record + SYSMON_RECORD_CRC_START,
+                                           record_size - SYSMON_RECORD_CRC_START);
+}
+
+#define SYSMON_JSON_LEN_KEY ",\"len\":"
+#define SYSMON_JSON_CRC_KEY ",\"crc32c\":\""
+#define SYSMON_JSON_CHECK_MAX 40 // Longest ,"len":N,"crc32c":"xxxxxxxx"}
+
+/**
+ * @brief Checks the length and CRC32C at the end of a JSON line, in O(1)
+ *        apart from the CRC itself.
+ * @param line Line without its newline.
+ * @param start Receives where the checked record starts within the line
+ *              (after any torn text in front of it).
+ * @return 1 if the record checks out, 0 if the line carries no check
+ *         (written before checksums existed), -1 if it is damaged.
+ */
+static inline int sysmon_json_verify(const char *line, size_t len, size_t *start) {
+    const size_t crc_key_len = sizeof(SYSMON_JSON_CRC_KEY) - 1;
+    const size_t len_key_len = sizeof(SYSMON_JSON_LEN_KEY) - 1;
+    const size_t tail = crc_key_len + 8 + 2;
+    if (len < tail || line[len - 1] != '}' || line[len - 2] != '"' ||
+        memcmp(line + len - tail, SYSMON_JSON_CRC_KEY, crc_key_len) != 0) {
+        return 0;
+    }
+
+    uint32_t crc = 0;
+    for (const char *p = line + len - 10; p < line + len - 2; p++) {
+        int digit = (*p >= '0' && *p <= '9') ? *p - '0' : (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 : -1;
+        if (digit < 0) return -1;
+        crc = (crc << 4) | (uint32_t)digit;
+    }
+
+    // The length's digits, read right to left
+    size_t pos = len - tail, checked = 0, scale = 1;
+    int digits = 0;
+    for (; pos > 0 && digits < 9 && line[pos - 1] >= '0' && line[pos - 1] <= '9'; pos--, digits++) {
+        checked += (size_t)(line[pos - 1] - '0') * scale;
+        scale *= 10;
+    }
+    if (digits == 0 || pos < len_key_len || memcmp(line + pos - len_key_len, SYSMON_JSON_LEN_KEY, len_key_len) != 0) {
+        return -1;
+    }
+
+    size_t body_end = pos - len_key_len;
+    if (checked > body_end || sysmon_crc32c(line + body_end - checked, checked) != crc) return -1;
+    *start = body_end - checked;
+    return 1;
+}
+
+/* --- Shared-memory ring --- */
+
+#ifndef SYSMON_SHM_NAME
+#define SYSMON_SHM_NAME       "/rpi-sysmon" // Tests define their own, away from a live ring
+#endif
+#define SYSMON_RING_MAGIC     "SYSMONR\n"
+#define SYSMON_RING_VERSION   2
+#define SYSMON_RING_CAPACITY  64
+#define SYSMON_RING_RETRIES   1000 // Give up if the writer died mid-publish
+
+/**
+ * Single-writer ring of binary records. Each slot is guarded by its own
+ * sequence counter (odd while being written), and write_seq counts the
+ * records published so far; the newest lives in slot (write_seq - 1) % capacity.
+ * Counters are 32-bit so they stay lock-free on ARMv6 (Pi Zero/1).
+ */
+typedef struct {
+    char magic[SYSMON_LOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;
+    uint32_t slot_size;
+    _Atomic uint32_t write_seq;
+    uint32_t reserved;
+} SysmonRing;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t reserved;
+    // record_size bytes of SysmonRecord follow
+} SysmonRingSlot;
+
+_Static_assert(sizeof(SysmonRing) == 32, "SysmonRing layout changed");
+_Static_assert(sizeof(SysmonRingSlot) == 8, "SysmonRingSlot layout changed");
+
+static inline uint32_t sysmon_ring_slot_size(uint32_t record_size) {
+    return (uint32_t)sizeof(SysmonRingSlot) + record_size;
+}
+
+static inline size_t sysmon_ring_size(uint32_t capacity, uint32_t slot_size) {
+    return sizeof(SysmonRing) + (size_t)capacity * slot_size;
+}
+
+static inline SysmonRingSlot *sysmon_ring_slot(SysmonRing *ring, uint32_t seq) {
+    return (SysmonRingSlot *)((char *)(ring + 1) + (size_t)(seq % ring->capacity) * ring->slot_size);
+}
+
+/**
+ * @brief Publishes one record (writer side). Only one process may write.
+ */
+static inline void sysmon_ring_publish(SysmonRing *ring, const SysmonRecord *record) {
+    uint32_t seq = atomic_load_explicit(&ring->write_seq, memory_order_relaxed);
+    SysmonRingSlot *slot = sysmon_ring_slot(ring, seq);
+
+    atomic_store_explicit(&slot->seq, 2 * seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(slot + 1, record, ring->record_size);
+    atomic_store_explicit(&slot->seq, 2 * seq + 2, memory_order_release);
+    atomic_store_explicit(&ring->write_seq, seq + 1, memory_order_release);
+}
+
+/**
+ * @brief Copies record number seq (counting from 0) out of the ring (reader side).
+ * @param out Buffer of at least ring->record_size bytes.
+ * @return 0 on success, -1 if the writer has lapped the record or is rewriting its slot.
+ */
+static inline int sysmon_ring_read(SysmonRing *ring, uint32_t seq, void *out) {
+    SysmonRingSlot *slot = sysmon_ring_slot(ring, seq);
+    uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (before != 2 * seq + 2) return -1;
+
+    memcpy(out, slot + 1, ring->record_size);
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before) ? 0 : -1;
+}
+
+/**
+ * @brief Copies the newest record out of the ring (reader side, no syscalls).
+ * @param out Buffer of at least ring->record_size bytes.
+ * @param seq_out Optional; receives the number of records published so far.
+ * @return 0 on success, -1 if nothing has been published yet.
+ */
+static inline int sysmon_ring_read_latest(SysmonRing *ring, void *out, uint32_t *seq_out) {
+    for (int attempt = 0; attempt < SYSMON_RING_RETRIES; attempt++) {
+        uint32_t seq = atomic_load_explicit(&ring->write_seq, memory_order_acquire);
+        if (seq == 0) return -1;
+        if (sysmon_ring_read(ring, seq - 1, out) != 0) continue; // Writer lapped us or is mid-write
+
+        if (seq_out) *seq_out = seq;
+        return 0;
+    }
+    return -1;
+}
+
+#endif // SYSMON_RECORD_H
@@ -0,0 +1,816 @@
+/**
+ * test_server.c
+ *
+ * Behaviour tests for monitor_server, built against the real
+ * monitor_server.c (its main() is renamed out of the way). The event
+ * loop is driven in-process, one batch at a time, by the test itself.
+ *
+ * Build and run: make test
+ */
+
+#define main monitor_server_main
+#include "../monitor_server.c"
+#undef main
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+/* --- Helpers --- */
+
+static int test_port;
+
+/**
+ * Opens a worker event loop on an ephemeral port.
+ */
+static void start_loop(EventLoop *loop) {
+    ServerConfig config = { .port = 0, .idle_timeout_sec = 5, .threads = 1, .backlog = 1024 };
+    memset(loop, 0, sizeof(*loop));
+    init_event_loop(loop, &config);
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(loop->listen_fd, (struct sockaddr *)&addr, &len);
+    test_port = ntohs(addr.sin_port);
+}
+
+/**
+ * Handles event batches for as long as the loop has any ready.
+ */
+static void pump(EventLoop *loop) {
+    struct pollfd pfd = { .fd = loop->epoll_fd, .events = POLLIN };
+    while (poll(&pfd, 1, 50) > 0) poll_event_loop(loop);
+}
+
+/**
+ * Publishes a new sample and wakes the loop like the sampler thread does.
+ */
+static void push_sample(EventLoop *loop) {
+    static double t = 1700000000.0;
+    static char line[] = "{}";
+    SystemData data = { .timestamp = ++t, .cpu_usage = 12.5, .mem_total = 1024, .interval_ms = 1000 };
+    RawSample raw = { .buf = line, .size = sizeof(line), .len = sizeof(line) - 1 };
+    publish_sample(&data, &raw, 1);
+
+    const uint64_t one = 1;
+    if (write(loop->notify_fd, &one, sizeof(one)) < 0) perror("eventfd");
+}
+
+static int connect_client(const char *request) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(test_port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    if (write(fd, request, strlen(request)) < 0) perror("write");
+    return fd;
+}
+
+/**
+ * Reads what the server has sent so far, NUL-terminated.
+ * @return Bytes read, 0 if the server closed the connection, -1 if nothing arrived.
+ */
+static ssize_t read_client(int fd, char *buf, size_t size) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, 100) <= 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+/**
+ * Closes with an RST instead of a FIN, like a client that crashed.
+ */
+static void reset_client(int fd) {
+    struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    close(fd);
+}
+
+static int count_subscribers(const EventLoop *loop) {
+    int n = 0;
+    for (const Connection *conn = loop->subscribers; conn; conn = conn->sub_next) n++;
+    return n;
+}
+
+/**
+ * Sends one request on a fresh connection and reads the response until
+ * the server closes the connection, running the loop meanwhile.
+ * @return Bytes read, NUL-terminated in buf.
+ */
+static size_t request(EventLoop *loop, const char *req, char *buf, size_t size) {
+    int fd = connect_client(req);
+    size_t len = 0;
+    for (;;) {
+        struct pollfd pfd[2] = { { .fd = loop->epoll_fd, .events = POLLIN }, { .fd = fd, .events = POLLIN } };
+        if (poll(pfd, 2, 1000) <= 0) break;
+        if (pfd[0].revents) poll_event_loop(loop);
+        if (!pfd[1].revents) continue;
+        ssize_t n = read(fd, buf + len, size - 1 - len);
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    buf[len] = '\0';
+    close(fd);
+    pump(loop);
+    return len;
+}
+
+/**
+ * Start of the body of a response read by request().
+ */
+static const char *response_body(const char *response) {
+    const char *body = strstr(response, "\r\n\r\n");
+    return body ? body + 4 : response + strlen(response);
+}
+
+/* --- JSON parsing --- */
+
+typedef struct {
+    char paths[16][JSON_PATH_SIZE];
+    int indexes[16];
+    double values[16];
+    int count;
+} Visited;
+
+static int record_visit(void *ctx, const char *path, size_t path_len, int index, double value) {
+    Visited *v = ctx;
+    if (v->count == 16 || strlen(path) != path_len) return -1;
+    strcpy(v->paths[v->count], path);
+    v->indexes[v->count] = index;
+    v->values[v->count++] = value;
+    return 0;
+}
+
+static const char *walk(const char *json, Visited *v) {
+    char path[JSON_PATH_SIZE] = "";
+    memset(v, 0, sizeof(*v));
+    return json_walk(json, json + strlen(json), path, 0, -1, 0, record_visit, v);
+}
+
+static void test_json_walk(void) {
+    Visited v;
+    const char *json = "{ \"a\": 1, \"b\": {\"c\": -2.5e1, \"s\": \"x\\\"}{,\", \"t\": true},"
+                       " \"arr\": [3, {\"d\": 4}], \"n\": null }";
+    CHECK(walk(json, &v) == json + strlen(json));
+    CHECK(v.count == 4);
+    CHECK(strcmp(v.paths[0], "a") == 0 && v.values[0] == 1 && v.indexes[0] == -1);
+    CHECK(strcmp(v.paths[1], "b.c") == 0 && v.values[1] == -25);
+    CHECK(strcmp(v.paths[2], "arr") == 0 && v.indexes[2] == 0 && v.values[2] == 3);
+    CHECK(strcmp(v.paths[3], "arr.d") == 0 && v.indexes[3] == 1 && v.values[3] == 4);
+
+    CHECK(walk("{}", &v) != NULL && v.count == 0);
+    CHECK(walk("[]", &v) != NULL && v.count == 0);
+
+    // Malformed input is rejected, never read past
+    CHECK(walk("", &v) == NULL);
+    CHECK(walk("{\"a\":1", &v) == NULL);
+    CHECK(walk("{\"a\" 1}", &v) == NULL);
+    CHECK(walk("{\"a\":1,}", &v) == NULL);
+    CHECK(walk("{a:1}", &v) == NULL);
+    CHECK(walk("{\"a\":\"open}", &v) == NULL);
+    CHECK(walk("[1 2]", &v) == NULL);
+    CHECK(walk("[[[[[[[[[[1]]]]]]]]]]", &v) == NULL); // Deeper than JSON_MAX_DEPTH
+
+    char long_key[JSON_PATH_SIZE + 16];
+    snprintf(long_key, sizeof(long_key), "{\"%0*d\":1}", JSON_PATH_SIZE, 0);
+    CHECK(walk(long_key, &v) == NULL);
+    printf("test_json_walk: ok\n");
+}
+
+/**
+ * Copies text into a heap block of exactly its length, with no NUL after
+ * it, so the sanitizer catches any read past the end.
+ */
+static char *unterminated(const char *text) {
+    size_t len = strlen(text);
+    char *buf = malloc(len);
+    memcpy(buf, text, len);
+    return buf;
+}
+
+/**
+ * Regression: numbers were converted with strtod(), which reads until it
+ * finds a non-digit whatever end says.
+ */
+static void test_json_walk_unterminated(void) {
+    Visited v;
+    char path[JSON_PATH_SIZE] = "";
+    char *number = unterminated("12.5");
+    memset(&v, 0, sizeof(v));
+    CHECK(json_walk(number, number + 4, path, 0, -1, 0, record_visit, &v) == number + 4);
+    CHECK(v.count == 1 && v.values[0] == 12.5);
+
+    // end falls inside the number: only the digits before it count
+    memset(&v, 0, sizeof(v));
+    CHECK(json_walk(number, number + 2, path, 0, -1, 0, record_visit, &v) == number + 2);
+    CHECK(v.count == 1 && v.values[0] == 12);
+    free(number);
+
+    char *array = unterminated("[1,-2e3");
+    memset(&v, 0, sizeof(v));
+    CHECK(json_walk(array, array + 7, path, 0, -1, 0, record_visit, &v) == NULL);
+    CHECK(v.count == 2 && v.values[1] == -2000);
+    free(array);
+
+    double timestamp;
+    size_t skip;
+    char *line = unterminated("{\"timestamp\":1700000000.5");
+    CHECK(parse_line_timestamp(line, 25, &timestamp, &skip) == 0 && timestamp == 1700000000.5);
+    free(line);
+    printf("test_json_walk_unterminated: ok\n");
+}
+
+static void test_json_parse_fields(void) {
+    // Sorted by path, as json_parse_fields() requires
+    JsonField fields[] = { { .path = "cpu.temp_c" }, { .path = "cpu.usage_pct" }, { .path = "missing" },
+                           { .path = "timestamp" } };
+    const char *json = "{\"timestamp\":12.5,\"cpu\":{\"usage_pct\":7,\"cores\":[1,2],\"usage_pct\":99},"
+                       "\"temp_c\":55}";
+    CHECK(json_parse_fields(json, strlen(json), fields, 4) == 0);
+    CHECK(fields[3].present && fields[3].value == 12.5);
+    CHECK(fields[1].present && fields[1].value == 7);   // The first occurrence wins
+    CHECK(!fields[0].present);                          // temp_c is not under cpu here
+    CHECK(!fields[2].present);
+
+    // Presence is reset on every call
+    CHECK(json_parse_fields("{\"missing\":1}", 13, fields, 4) == 0);
+    CHECK(fields[2].present && !fields[3].present);
+    CHECK(json_parse_fields("{\"timestamp\":", 13, fields, 4) == -1);
+    printf("test_json_parse_fields: ok\n");
+}
+
+static void test_parse_sample_line(void) {
+    static char buf[256];
+    RawSample raw = { buf, sizeof(buf), 0 };
+    SystemData data;
+
+    const char *line = "{\"timestamp\":1700000000.25,\"uptime_sec\":3600.5,\"interval_ms\":500,"
+                       "\"cpu\":{\"usage_pct\":12.5,\"temp_c\":48.2},"
+                       "\"memory\":{\"total_kb\":1000,\"free_kb\":250,\"used_pct\":75.0}}";
+    CHECK(parse_sample_line(line, strlen(line), &data, &raw) == 0);
+    CHECK(data.timestamp == 1700000000.25);
+    CHECK(data.uptime == 3600.5);
+    CHECK(data.interval_ms == 500);
+    CHECK(data.cpu_usage == 12.5 && data.cpu_temp == 48.2);
+    CHECK(data.mem_total == 1000 && data.mem_free == 250 && data.mem_used_pct == 75.0);
+    CHECK(raw.len == strlen(line) + 1 && memcmp(raw.buf, line, strlen(line)) == 0 && raw.buf[raw.len - 1] == '\n');
+
+    // Absent readings are unavailable (-1), not zero
+    line = "{\"timestamp\":5,\"interval_ms\":0}";
+    CHECK(parse_sample_line(line, strlen(line), &data, &raw) == 0);
+    CHECK(data.cpu_temp == -1.0 && data.cpu_usage == -1.0 && data.mem_total == -1);
+    CHECK(data.interval_ms == DEFAULT_SAMPLE_INTERVAL_MS);
+
+    // Not a sample, malformed, or longer than the copy can hold
+    line = "{\"uptime_sec\":1,\"timestamp\":5}";
+    CHECK(parse_sample_line(line, strlen(line), &data, &raw) == -1);
+    line = "{\"timestamp\":5,";
+    CHECK(parse_sample_line(line, strlen(line), &data, &raw) == -1);
+    raw.size = 16;
+    line = "{\"timestamp\":1700000000}";
+    CHECK(parse_sample_line(line, strlen(line), &data, &raw) == -1);
+    printf("test_parse_sample_line: ok\n");
+}
+
+/* --- Checksums --- */
+
+/**
+ * Writes body followed by sysmon's length and CRC32C check into line.
+ * @return Length of the sealed line.
+ */
+static size_t seal_json(char *line, size_t size, const char *body) {
+    size_t len = strlen(body);
+    int n = snprintf(line, size, "%s" SYSMON_JSON_LEN_KEY "%zu" SYSMON_JSON_CRC_KEY "%08x\"}",
+                     body, len, sysmon_crc32c(body, len));
+    return (size_t)n;
+}
+
+static void test_sysmon_json_verify(void) {
+    char line[512];
+    size_t start = 99;
+    const char *body = "{\"timestamp\":1700000000.5,\"cpu\":{\"usage_pct\":12.5}";
+    size_t len = seal_json(line, sizeof(line), body);
+    CHECK(sysmon_json_verify(line, len, &start) == 1 && start == 0);
+
+    // Lines from before checksums carry no check
+    CHECK(sysmon_json_verify("{\"timestamp\":1}", 15, &start) == 0);
+
+    // Damage anywhere is caught
+    line[20] ^= 1;
+    CHECK(sysmon_json_verify(line, len, &start) == -1);
+    line[20] ^= 1;
+    line[len - 4] = 'g';    // Not a hex digit
+    CHECK(sysmon_json_verify(line, len, &start) == -1);
+
+    // A length reaching before the line
+    char bad[512];
+    int n = snprintf(bad, sizeof(bad), "{\"a\":1" SYSMON_JSON_LEN_KEY "999" SYSMON_JSON_CRC_KEY "%08x\"}",
+                     sysmon_crc32c("{\"a\":1", 6));
+    CHECK(sysmon_json_verify(bad, (size_t)n, &start) == -1);
+
+    // The record behind torn text is taken from its own start
+    char torn[600];
+    int prefix = snprintf(torn, sizeof(torn), "{\"timestamp\":16");
+    len = seal_json(torn + prefix, sizeof(torn) - (size_t)prefix, body) + (size_t)prefix;
+    CHECK(sysmon_json_verify(torn, len, &start) == 1 && start == (size_t)prefix);
+
+    static char buf[600];
+    RawSample raw = { buf, sizeof(buf), 0 };
+    SystemData data;
+    CHECK(parse_sample_line(torn, len, &data, &raw) == 0);
+    CHECK(data.timestamp == 1700000000.5 && data.cpu_usage == 12.5);
+    CHECK(raw.len == len - (size_t)prefix + 1 && memcmp(raw.buf, torn + prefix, raw.len - 1) == 0);
+
+    double timestamp;
+    size_t skip;
+    CHECK(parse_line_timestamp(torn, len, &timestamp, &skip) == 0);
+    CHECK(timestamp == 1700000000.5 && skip == (size_t)prefix);
+
+    // A damaged sample is dropped rather than published
+    torn[prefix + 20] ^= 1;
+    CHECK(parse_sample_line(torn, len, &data, &raw) == -1);
+    CHECK(parse_line_timestamp(torn, len, &timestamp, &skip) == -1);
+    printf("test_sysmon_json_verify: ok\n");
+}
+
+/* --- Responses --- */
+
+static void test_metrics_match_validators(void) {
+    static EventLoop loop;
+    static char buf[METRICS_BUFFER_SIZE + 1024];
+    start_loop(&loop);
+
+    char line[] = "{\"timestamp\":1700000123.25,\"cpu\":{\"usage_pct\":42.5}}";
+    SystemData data = { .timestamp = 1700000123.25, .cpu_usage = 42.5, .interval_ms = 1000 };
+    RawSample raw = { .buf = line, .size = sizeof(line), .len = sizeof(line) - 1 };
+    publish_sample(&data, &raw, 1);
+
+    request(&loop, "GET /metrics HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", buf, sizeof(buf));
+    CHECK(strstr(buf, "HTTP/1.1 200 OK\r\n") == buf);
+    CHECK(strstr(buf, "ETag: \"1700000123250\"\r\n") != NULL);
+    CHECK(strstr(buf, "\nsysmon_cpu_usage_percent 42.5\n") != NULL);
+
+    request(&loop, "GET /api/latest HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", buf, sizeof(buf));
+    CHECK(strstr(buf, "ETag: \"1700000123250\"\r\n") != NULL);
+    CHECK(strstr(buf, line) != NULL);
+    close(loop.listen_fd);
+    close(loop.epoll_fd);
+    printf("test_metrics_match_validators: ok\n");
+}
+
+/* --- Dashboard --- */
+
+/**
+ * Regression: a template with the most parts allowed needs every iovec of
+ * a cached gzip response, head, gzip header and trailer included.
+ */
+static void test_dashboard_gzip_max_parts(void) {
+    static char text[MAX_PAGE_PARTS][16];
+    page_part_count = 0;
+    for (int i = 0; i < MAX_PAGE_PARTS; i++) {
+        if (i % 2 == 0) {
+            int len = snprintf(text[i], sizeof(text[i]), "<p>%d:", i);
+            page_parts[page_part_count++] = (PagePart){ .text = text[i], .len = (size_t)len, .slot = -1 };
+        } else {
+            page_parts[page_part_count++] = (PagePart){ .slot = (i / 2) % PAGE_SLOT_COUNT };
+        }
+    }
+    compress_page_template();
+
+    static EventLoop loop;
+    static char plain[16384], gz[16384], inflated[16384];
+    start_loop(&loop);
+    push_sample(&loop);
+    request(&loop, "GET / HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", plain, sizeof(plain));
+    size_t len = request(&loop, "GET / HTTP/1.1\r\nHost: test\r\nAccept-Encoding: gzip\r\n"
+                                "Connection: close\r\n\r\n", gz, sizeof(gz));
+    CHECK(strstr(plain, "HTTP/1.1 200 OK\r\n") == plain);
+    CHECK(strstr(gz, "Content-Encoding: gzip\r\n") != NULL);
+
+    // The gzip body inflates to the identity body
+    const char *body = response_body(gz);
+    z_stream zs = {0};
+    CHECK(inflateInit2(&zs, 16 + MAX_WBITS) == Z_OK);
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = (uInt)(len - (size_t)(body - gz));
+    zs.next_out = (Bytef *)inflated;
+    zs.avail_out = sizeof(inflated) - 1;
+    CHECK(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+    inflated[zs.total_out] = '\0';
+    inflateEnd(&zs);
+    CHECK(strcmp(inflated, response_body(plain)) == 0);
+    CHECK(strncmp(inflated, "<p>0:12.5<p>2:", 14) == 0);
+
+    for (int i = 0; i < page_part_count; i++) free(page_parts[i].gz);
+    page_part_count = 0;
+    printf("test_dashboard_gzip_max_parts: ok\n");
+}
+
+/* --- Rollups --- */
+
+static int count_points(const char *body) {
+    int n = 0;
+    for (const char *p = body; (p = strstr(p, "{\"t\":")); p++) n++;
+    return n;
+}
+
+static void test_rollup_ranges(void) {
+    init_rollups(8);
+    for (int t = 0; t < 12; t++) {
+        SystemData data = { .timestamp = 1700000100.0 + t, .cpu_usage = t, .mem_used_pct = -1,
+                            .cpu_temp = -1, .mem_free = 1000 };
+        rollup_add(&data);
+    }
+
+    static EventLoop loop;
+    static char buf[16384];
+    start_loop(&loop);
+    push_sample(&loop);
+
+    // The 1 s ring has wrapped: only the newest 8 buckets remain
+    request(&loop, "GET /api/rollup?res=1 HTTP/1.1\r\nConnection: close\r\n\r\n", buf, sizeof(buf));
+    CHECK(count_points(response_body(buf)) == 8);
+    CHECK(strstr(buf, "\"points\":[{\"t\":1700000104,") != NULL);
+
+    request(&loop, "GET /api/rollup?res=1&from=1700000106&to=1700000108 HTTP/1.1\r\nConnection: close\r\n\r\n",
+            buf, sizeof(buf));
+    CHECK(count_points(response_body(buf)) == 3);
+    CHECK(strstr(buf, "\"points\":[{\"t\":1700000106,") != NULL);
+    CHECK(strstr(buf, "{\"t\":1700000108,\"cpu_pct\":[8.0,8.0,8.0,8.0],\"mem_used_pct\":null") != NULL);
+
+    request(&loop, "GET /api/rollup?res=1&from=1700000200 HTTP/1.1\r\nConnection: close\r\n\r\n", buf, sizeof(buf));
+    CHECK(strstr(buf, "\"points\":[]}\n") != NULL);
+
+    // Coarser buckets aggregate every sample that falls in them
+    request(&loop, "GET /api/rollup?res=10 HTTP/1.1\r\nConnection: close\r\n\r\n", buf, sizeof(buf));
+    CHECK(count_points(response_body(buf)) == 2);
+    CHECK(strstr(buf, "{\"t\":1700000100,\"cpu_pct\":[0.0,9.0,4.5,9.0]") != NULL);
+    CHECK(strstr(buf, "{\"t\":1700000110,\"cpu_pct\":[10.0,11.0,10.5,11.0]") != NULL);
+    printf("test_rollup_ranges: ok\n");
+}
+
+/**
+ * Publishes a one-slot record with the given time and CPU usage to a ring.
+ */
+static void publish_record(SysmonRing *ring, double timestamp, double cpu_pct) {
+    SysmonRecord *record = calloc(1, ring->record_size);
+    record->length = ring->record_size;
+    record->timestamp_ns = (int64_t)(timestamp * 1e9);
+    record->interval_ms = 20;
+    record->cpu_slots = 1;
+    record->cpu[0] = (uint16_t)(cpu_pct * 10);
+    sysmon_ring_publish(ring, record);
+    free(record);
+}
+
+/**
+ * Regression: with an interval below SAMPLE_POLL_MS, the rollups only
+ * received the newest ring record of each poll.
+ */
+static void test_rollup_ring_records(void) {
+    free(rollups.buckets);
+    memset(rollups.head, 0, sizeof(rollups.head));
+    memset(rollups.used, 0, sizeof(rollups.used));
+    init_rollups(8);
+
+    uint32_t record_size = sysmon_record_size(1);
+    uint32_t slot_size = sysmon_ring_slot_size(record_size);
+    SysmonRing *ring = calloc(1, sysmon_ring_size(8, slot_size));
+    ring->version = SYSMON_RING_VERSION;
+    ring->capacity = 8;
+    ring->record_size = record_size;
+    ring->slot_size = slot_size;
+    shm_ring = ring;
+    shm_rollup_seq = 0;
+
+    // Five records between two polls all land in the bucket
+    for (int i = 1; i <= 5; i++) publish_record(ring, 1700000200.0 + i * 0.02, i * 10.0);
+    rollup_add_ring();
+    const RollupStat *stat = &rollup_bucket(0, rollups.used[0] - 1)->stat[ROLLUP_CPU_PCT];
+    CHECK(stat->count == 5 && stat->min == 10.0f && stat->max == 50.0f && stat->sum == 150.0);
+
+    // Nothing new: nothing folded twice
+    rollup_add_ring();
+    CHECK(stat->count == 5);
+
+    // A writer that lapped the reader leaves the newest capacity records
+    for (int i = 0; i < 20; i++) publish_record(ring, 1700000201.0 + i * 0.02, 1.0);
+    rollup_add_ring();
+    CHECK(rollup_bucket(0, rollups.used[0] - 1)->stat[ROLLUP_CPU_PCT].count == 8);
+
+    shm_ring = NULL;
+    free(ring);
+    printf("test_rollup_ring_records: ok\n");
+}
+
+/**
+ * An idle ring costs one load of write_seq per poll: the newest record is
+ * only copied and rendered as JSON when the writer has moved on.
+ */
+static void test_shm_unchanged_seq(void) {
+    uint32_t record_size = sysmon_record_size(1);
+    uint32_t slot_size = sysmon_ring_slot_size(record_size);
+    SysmonRing *ring = calloc(1, sysmon_ring_size(8, slot_size));
+    ring->version = SYSMON_RING_VERSION;
+    ring->capacity = 8;
+    ring->record_size = record_size;
+    ring->slot_size = slot_size;
+    shm_ring = ring;
+    shm_ring_len = sysmon_ring_size(8, slot_size);
+    shm_published_seq = 0;
+
+    static char buf[RAW_SAMPLE_SIZE];
+    RawSample raw = { buf, sizeof(buf), 0 };
+    SystemData data = {0};
+    double now = wall_ms() / 1000.0;
+    publish_record(ring, now, 25.0);
+    CHECK(get_shm_data(&data, &raw) == 0);
+    CHECK(raw.len > 0 && data.cpu_usage == 25.0);
+
+    raw.len = 0;
+    data.cpu_usage = -1;
+    CHECK(get_shm_data(&data, &raw) == 1);
+    CHECK(raw.len == 0 && data.cpu_usage == -1); // Nothing copied, nothing formatted
+
+    publish_record(ring, now + 0.02, 30.0);
+    CHECK(get_shm_data(&data, &raw) == 0);
+    CHECK(raw.len > 0 && data.cpu_usage == 30.0);
+
+    shm_ring = NULL;
+    shm_published_seq = 0;
+    free(ring);
+    printf("test_shm_unchanged_seq: ok\n");
+}
+
+/* --- Range queries --- */
+
+enum { RANGE_LINES = 6000, RANGE_FIRST = 1000 };
+static char range_log[RANGE_LINES * 128 + 8192];
+static size_t range_line_offset[RANGE_LINES + 1];
+
+/**
+ * Writes a JSON log with one sample a second from RANGE_FIRST.5 on. One
+ * line is far longer than an index probe's first read.
+ */
+static void write_json_log(void) {
+    size_t len = 0;
+    for (int i = 0; i < RANGE_LINES; i++) {
+        range_line_offset[i] = len;
+        len += (size_t)sprintf(range_log + len, "{\"timestamp\":%d.5,\"cpu\":{\"usage_pct\":%d.0},\"pad\":\"",
+                               RANGE_FIRST + i, i % 100);
+        size_t pad = (i == 1500) ? 6000 : (size_t)(40 + i % 50);
+        memset(range_log + len, 'x', pad);
+        len += pad;
+        len += (size_t)sprintf(range_log + len, "\"}\n");
+    }
+    range_line_offset[RANGE_LINES] = len;
+
+    FILE *f = fopen(MONITOR_FILE, "w");
+    fwrite(range_log, 1, len, f);
+    fclose(f);
+}
+
+/**
+ * Checks that /api/range?from=&to= answers exactly lines [first, last).
+ */
+static void check_json_range(EventLoop *loop, const char *query, int first, int last) {
+    static char buf[sizeof(range_log) + 4096];
+    char req[256];
+    snprintf(req, sizeof(req), "GET /api/range?%s HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", query);
+    request(loop, req, buf, sizeof(buf));
+
+    const char *body = response_body(buf);
+    size_t want = range_line_offset[last] - range_line_offset[first];
+    CHECK(strstr(buf, "HTTP/1.1 200 OK\r\n") == buf);
+    CHECK(strstr(buf, "Content-Type: application/x-ndjson\r\n") != NULL);
+    CHECK(strlen(body) == want);
+    CHECK(memcmp(body, range_log + range_line_offset[first], want) == 0);
+}
+
+static void test_json_range(void) {
+    static EventLoop loop;
+    start_loop(&loop);
+    write_json_log();
+    update_log_index();
+
+    // One entry per stride, each at a line start and in time order
+    CHECK(log_index.count >= range_line_offset[RANGE_LINES] / LOG_INDEX_STRIDE);
+    CHECK(log_index.end == (off_t)range_line_offset[RANGE_LINES]);
+    for (size_t i = 0; i < log_index.count; i++) {
+        off_t offset = log_index.entries[i].offset;
+        CHECK(offset == 0 || range_log[offset - 1] == '\n');
+        CHECK(i == 0 || log_index.entries[i].timestamp > log_index.entries[i - 1].timestamp);
+    }
+
+    check_json_range(&loop, "from=1010&to=1020", 10, 20);
+    check_json_range(&loop, "from=1010.5&to=1019.5", 10, 20);
+    check_json_range(&loop, "from=2400&to=2600", 1400, 1600);     // Across the long line
+    check_json_range(&loop, "from=0&to=1005", 0, 5);
+    check_json_range(&loop, "from=6990", 5990, RANGE_LINES);
+    check_json_range(&loop, "to=1e18", 0, RANGE_LINES);
+    check_json_range(&loop, "from=5000.6&to=5000.9", 4001, 4001);  // Between two samples
+
+    static char buf[4096];
+    request(&loop, "GET /api/range?from=20&to=10 HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n",
+            buf, sizeof(buf));
+    CHECK(strstr(buf, "HTTP/1.1 400 Bad Request\r\n") == buf);
+
+    // A half-written last line is not served until it is complete
+    FILE *f = fopen(MONITOR_FILE, "a");
+    fputs("{\"timestamp\":9999.5,\"cpu\":{", f);
+    fclose(f);
+    update_log_index();
+    CHECK(log_index.end == (off_t)range_line_offset[RANGE_LINES]);
+    check_json_range(&loop, "from=6990", 5990, RANGE_LINES);
+    printf("test_json_range: ok\n");
+}
+
+static void test_binary_range(void) {
+    static EventLoop loop;
+    static char buf[64 * 1024];
+    start_loop(&loop);
+
+    uint32_t record_size = sysmon_record_size(1);
+    SysmonLogHeader header = { .version = SYSMON_LOG_VERSION, .header_size = sizeof(header), .cpu_slots = 1,
+                               .cpu_columns = SYSMON_CPU_COLUMNS, .record_size = record_size };
+    memcpy(header.magic, SYSMON_LOG_MAGIC, SYSMON_LOG_MAGIC_LEN);
+    FILE *f = fopen(MONITOR_FILE, "w");
+    fwrite(&header, sizeof(header), 1, f);
+    SysmonRecord *rec = calloc(1, record_size);
+    for (int i = 0; i < 100; i++) {
+        rec->timestamp_ns = (int64_t)(2000 + i) * 1000000000;
+        rec->interval_ms = 1000;
+        sysmon_record_seal(rec, record_size);
+        fwrite(rec, record_size, 1, f);
+    }
+    fwrite(rec, record_size / 2, 1, f); // Torn last record
+    fclose(f);
+    free(rec);
+    update_log_index();
+    CHECK(log_index.binary);
+
+    // The body is itself a log: the header, then records 2010 to 2019
+    size_t len = request(&loop, "GET /api/range?from=2010&to=2019 HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n",
+                         buf, sizeof(buf));
+    const char *body = response_body(buf);
+    size_t body_len = len - (size_t)(body - buf);
+    CHECK(strstr(buf, "Content-Type: application/octet-stream\r\n") != NULL);
+    CHECK(body_len == sizeof(header) + 10 * record_size);
+    CHECK(memcmp(body, &header, sizeof(header)) == 0);
+    rec = malloc(record_size);
+    for (int i = 0; i < 10 && body_len == sizeof(header) + 10 * record_size; i++) {
+        memcpy(rec, body + sizeof(header) + (size_t)i * record_size, record_size);
+        CHECK(sysmon_record_valid(rec, record_size));
+        CHECK(rec->timestamp_ns == (int64_t)(2010 + i) * 1000000000);
+    }
+    free(rec);
+
+    // The torn record is left out
+    len = request(&loop, "GET /api/range?from=2095 HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n",
+                  buf, sizeof(buf));
+    CHECK(len - (size_t)(response_body(buf) - buf) == sizeof(header) + 5 * record_size);
+    unlink(MONITOR_FILE);
+    printf("test_binary_range: ok\n");
+}
+
+/* --- SSE --- */
+
+static void test_sse_lifecycle(void) {
+    static EventLoop loop;
+    char buf[4096];
+    start_loop(&loop);
+    push_sample(&loop);
+
+    int fd = connect_client("GET /events HTTP/1.1\r\nHost: test\r\n\r\n");
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, "HTTP/1.1 200 OK\r\n") == buf);
+    CHECK(strstr(buf, "Content-Type: text/event-stream\r\n") != NULL);
+    CHECK(strstr(buf, "Connection: close\r\n") != NULL);
+    CHECK(strstr(buf, "data: {") != NULL);
+    CHECK(count_subscribers(&loop) == 1);
+
+    // Every new sample is pushed as one event
+    push_sample(&loop);
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strncmp(buf, "data: {", 7) == 0);
+
+    // Idle past the timeout: a heartbeat comment instead of a close
+    loop.idle_timeout_ms = 50;
+    usleep(80 * 1000);
+    poll_event_loop(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) == 3);
+    CHECK(strcmp(buf, ":\n\n") == 0);
+    CHECK(count_subscribers(&loop) == 1);
+    loop.idle_timeout_ms = 5000;
+
+    close(fd);
+    pump(&loop);
+    CHECK(count_subscribers(&loop) == 0);
+    CHECK(loop.connections == 0);
+
+    // HTTP/1.0 without keep-alive still gets a stream that stays open
+    fd = connect_client("GET /events HTTP/1.0\r\n\r\n");
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, "Connection: close\r\n") != NULL);
+    push_sample(&loop);
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strncmp(buf, "data: {", 7) == 0);
+    close(fd);
+    pump(&loop);
+
+    // HEAD gets the headers only and, as announced, the connection is closed
+    fd = connect_client("HEAD /events HTTP/1.1\r\nHost: test\r\n\r\n");
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, "data:") == NULL);
+    CHECK(read_client(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+    pump(&loop);
+    CHECK(loop.connections == 0);
+    CHECK(count_subscribers(&loop) == 0);
+    printf("test_sse_lifecycle: ok\n");
+}
+
+/**
+ * Regression: a push that fails on a reset subscriber closed it while an
+ * EPOLLHUP for the same connection was still queued in the batch.
+ */
+static void test_sse_subscribers_reset_under_load(void) {
+    enum { CLIENTS = 200, ROUNDS = 10 };
+    static EventLoop loop;
+    static int fds[CLIENTS];
+    start_loop(&loop);
+    push_sample(&loop);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < CLIENTS; i++) fds[i] = connect_client("GET /events HTTP/1.1\r\nHost: test\r\n\r\n");
+        pump(&loop);
+        CHECK(count_subscribers(&loop) == CLIENTS);
+
+        // The wakeup is queued ahead of the hangups, so pushes hit reset sockets first
+        push_sample(&loop);
+        for (int i = 0; i < CLIENTS; i++) reset_client(fds[i]);
+        pump(&loop);
+        CHECK(count_subscribers(&loop) == 0);
+        CHECK(loop.connections == 0);
+    }
+
+    // The loop still serves requests afterwards
+    char buf[4096];
+    int fd = connect_client("GET /events HTTP/1.1\r\nHost: test\r\n\r\n");
+    pump(&loop);
+    CHECK(read_client(fd, buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, "HTTP/1.1 200 OK\r\n") == buf);
+    close(fd);
+    pump(&loop);
+    printf("test_sse_subscribers_reset_under_load: ok\n");
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+    init_line_scanner();
+    sysmon_crc32c_init();
+    start_range_lookup_thread();
+
+    // The server reads its log from the working directory
+    char dir[] = "/tmp/test_server.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        perror(dir);
+        return EXIT_FAILURE;
+    }
+
+    test_json_walk();
+    test_json_walk_unterminated();
+    test_json_parse_fields();
+    test_parse_sample_line();
+    test_sysmon_json_verify();
+    test_metrics_match_validators();
+    test_dashboard_gzip_max_parts();
+    test_rollup_ranges();
+    test_rollup_ring_records();
+    test_shm_unchanged_seq();
+    test_json_range();
+    test_binary_range();
+    test_sse_lifecycle();
+    test_sse_subscribers_reset_under_load();
+
+    rmdir(dir);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,500 @@
+/**
+ * test_sysmon.c
+ *
+ * Behaviour tests for sysmon's parsers and kernels, built against the
+ * real sysmon.c (its main() is renamed out of the way).
+ *
+ * Build and run: make test
+ */
+
+#define SYSMON_SHM_NAME "/rpi-sysmon-test"
+#define main sysmon_main
+#include "../sysmon.c"
+#undef main
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static void test_cpu_usage_counter_going_backwards(void) {
+    static CpuSnapshot prev, curr;
+    static double usage[CPU_SLOT_STRIDE];
+    static double share[CPU_FIELD_COUNT][CPU_SLOT_STRIDE];
+
+    prev.count = curr.count = 2;
+    for (int i = 0; i < 2; i++) {
+        prev.field[CPU_USER][i] = 1000;
+        curr.field[CPU_USER][i] = 1050;
+        prev.field[CPU_IDLE][i] = 5000;
+        curr.field[CPU_IDLE][i] = 5050;
+        // Per-CPU iowait can decrease between reads
+        prev.field[CPU_IOWAIT][i] = 700;
+        curr.field[CPU_IOWAIT][i] = 690;
+    }
+    calculate_cpu_usage(&prev, &curr, usage, share, 2);
+
+    for (int i = 0; i < 2; i++) {
+        CHECK(share[CPU_IOWAIT][i] == 0.0);
+        CHECK(usage[i] == 50.0);
+        CHECK(share[CPU_USER][i] == 50.0);
+        CHECK(share[CPU_IDLE][i] == 50.0);
+    }
+}
+
+static void test_cpu_usage_idle_interval(void) {
+    static CpuSnapshot snap;
+    static double usage[CPU_SLOT_STRIDE];
+    static double share[CPU_FIELD_COUNT][CPU_SLOT_STRIDE];
+
+    snap.count = 1;
+    snap.field[CPU_USER][0] = 42;
+    calculate_cpu_usage(&snap, &snap, usage, share, 1);
+    CHECK(usage[0] == 0.0);
+    CHECK(share[CPU_USER][0] == 0.0);
+}
+
+static int near(double a, double b) {
+    return a - b < 1e-9 && b - a < 1e-9;
+}
+
+static void test_cpu_usage_matches_per_slot_sums(void) {
+    static CpuSnapshot prev, curr;
+    static double usage[CPU_SLOT_STRIDE];
+    static double share[CPU_FIELD_COUNT][CPU_SLOT_STRIDE];
+
+    // An odd slot count leaves part of the last vector step unused
+    enum { SLOTS = 7 };
+    unsigned seed = 7;
+    prev.count = curr.count = SLOTS;
+    for (int f = 0; f < CPU_FIELD_COUNT; f++) {
+        for (int i = 0; i < SLOTS; i++) {
+            seed = seed * 1103515245 + 12345;
+            prev.field[f][i] = 1000000 + (seed >> 16) % 1000;
+            curr.field[f][i] = prev.field[f][i] + (seed >> 8) % 500;
+        }
+    }
+    calculate_cpu_usage(&prev, &curr, usage, share, SLOTS);
+
+    for (int i = 0; i < SLOTS; i++) {
+        double d[CPU_FIELD_COUNT];
+        for (int f = 0; f < CPU_FIELD_COUNT; f++) d[f] = (double)(curr.field[f][i] - prev.field[f][i]);
+        double busy = d[CPU_USER] + d[CPU_NICE] + d[CPU_SYSTEM] + d[CPU_IRQ] + d[CPU_SOFTIRQ] + d[CPU_STEAL];
+        double total = busy + d[CPU_IDLE] + d[CPU_IOWAIT];
+        CHECK(near(usage[i], busy * 100.0 / total));
+        for (int f = 0; f < CPU_FIELD_COUNT; f++) CHECK(near(share[f][i], d[f] * 100.0 / total));
+    }
+}
+
+static void parse_text(const char *text, SystemState *state) {
+    memset(state, 0, sizeof(*state));
+    parse_meminfo(text, strlen(text), state);
+}
+
+static void test_meminfo_fields(void) {
+    static SystemState state;
+    // SwapCached comes first here: it must not be taken for Cached
+    parse_text("MemTotal:        3880968 kB\n"
+               "SwapCached:         1804 kB\n"
+               "MemFree:         2295772 kB\n"
+               "MemAvailable:    3203144 kB\n"
+               "Buffers:           71520 kB\n"
+               "Cached:           941336 kB\n"
+               "SwapTotal:        102396 kB\n"
+               "SwapFree:          96764 kB\n"
+               "Dirty:                84 kB\n"
+               "Shmem:             20196 kB\n", &state);
+    CHECK(state.mem_total_kb == 3880968);
+    CHECK(state.mem_free_kb == 2295772);
+    CHECK(state.mem_available_kb == 3203144);
+    CHECK(state.buffers_kb == 71520);
+    CHECK(state.cached_kb == 941336);
+    CHECK(state.swap_total_kb == 102396);
+    CHECK(state.swap_free_kb == 96764);
+    CHECK(state.dirty_kb == 84);
+    CHECK(state.shmem_kb == 20196);
+}
+
+static void test_meminfo_stops_once_all_found(void) {
+    static SystemState state;
+    // Lines after the last wanted key are never looked at
+    parse_text("MemTotal: 100 kB\nMemFree: 1 kB\nMemAvailable: 2 kB\nBuffers: 3 kB\nCached: 4 kB\n"
+               "SwapTotal: 5 kB\nSwapFree: 6 kB\nDirty: 7 kB\nShmem: 8 kB\n"
+               "MemTotal: 999 kB\nCached: 999 kB\n", &state);
+    CHECK(state.mem_total_kb == 100);
+    CHECK(state.cached_kb == 4);
+    CHECK(state.shmem_kb == 8);
+}
+
+static void test_meminfo_absent_keys(void) {
+    static SystemState state;
+    // A 3.x kernel without MemAvailable, and no swap lines at all
+    parse_text("MemTotal:         947756 kB\n"
+               "MemFree:          511224 kB\n"
+               "Buffers:           40960 kB\n"
+               "Cached:           284012 kB\n"
+               "Shmem:              7836 kB", &state);
+    CHECK(state.mem_total_kb == 947756);
+    CHECK(state.mem_available_kb == 0);
+    CHECK(state.swap_total_kb == 0 && state.swap_free_kb == 0 && state.dirty_kb == 0);
+    // The last line has no newline; its value ends at the buffer
+    CHECK(state.shmem_kb == 7836);
+
+    // A key alone on a line, or a prefix of a key, fills nothing
+    parse_text("MemTotal:\nMemTotalX: 5 kB\nMem: 6 kB\n", &state);
+    CHECK(state.mem_total_kb == 0);
+}
+
+static void test_crc32c(void) {
+    // The CRC-32C check value
+    CHECK(sysmon_crc32c("123456789", 9) == 0xe3069283u);
+    CHECK(sysmon_crc32c("", 0) == 0);
+
+    // Hardware and table implementations agree at every length and alignment
+    static unsigned char buf[256];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)(i * 131 + 7);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len = 0; len + offset <= 64; len++) {
+            CHECK(sysmon_crc32c_update(~0u, buf + offset, len) == sysmon_crc32c_sw(~0u, buf + offset, len));
+        }
+    }
+}
+
+/**
+ * Points stdout at a new temporary file that already holds prefix_len
+ * bytes, so the sink starts at an offset that is not page-aligned.
+ * @return The previous stdout, for restore_stdout().
+ */
+static int stdout_to_tmpfile(FILE **tmp, size_t prefix_len) {
+    *tmp = tmpfile();
+    for (size_t i = 0; i < prefix_len; i++) fputc('#', *tmp);
+    fflush(*tmp);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(*tmp), STDOUT_FILENO);
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+/**
+ * Reads a whole file back, NUL-terminated.
+ * @return Its length.
+ */
+static size_t read_back(FILE *file, char *buf, size_t size) {
+    ssize_t len = pread(fileno(file), buf, size - 1, 0);
+    buf[len > 0 ? len : 0] = '\0';
+    return len > 0 ? (size_t)len : 0;
+}
+
+static off_t file_size(FILE *file) {
+    struct stat st;
+    return fstat(fileno(file), &st) == 0 ? st.st_size : -1;
+}
+
+/**
+ * Runs print_json() with stdout redirected to a temporary file.
+ * @return Length of the line written into buf.
+ */
+static size_t capture_json(const SystemState *state, char *buf, size_t size) {
+    static const Config config = { .interval_ms = 1000, .batch_samples = 1, .fsync = FSYNC_NONE };
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, 0);
+
+    OutputSink sink;
+    sink_init(&sink, &config);
+    print_json(state, &sink);
+    sink_flush(&sink, 1);
+    free(sink.buf);
+
+    restore_stdout(saved);
+    size_t len = read_back(tmp, buf, size);
+    fclose(tmp);
+    return len;
+}
+
+static void test_json_record_checksum(void) {
+    static SystemState state;
+    static char line[JSON_BUFFER_SIZE];
+    state.cpu_slots = 1;
+    state.mem_total_kb = 1000;
+    state.mem_available_kb = 400;
+    state.temp_c = 48.5;
+
+    size_t len = capture_json(&state, line, sizeof(line));
+    CHECK(len > 0 && line[len - 1] == '\n');
+    len--;
+
+    size_t start = 99;
+    CHECK(sysmon_json_verify(line, len, &start) == 1);
+    CHECK(start == 0);
+
+    // Torn text in front of the record is found and skipped
+    static char torn[JSON_BUFFER_SIZE + 16];
+    int prefix = snprintf(torn, sizeof(torn), "{\"timest");
+    memcpy(torn + prefix, line, len);
+    CHECK(sysmon_json_verify(torn, len + (size_t)prefix, &start) == 1);
+    CHECK(start == (size_t)prefix);
+
+    // Any changed byte is caught
+    line[10] ^= 1;
+    CHECK(sysmon_json_verify(line, len, &start) == -1);
+    line[10] ^= 1;
+    line[len - 3] = (line[len - 3] == '0') ? '1' : '0';
+    CHECK(sysmon_json_verify(line, len, &start) == -1);
+}
+
+static void test_binary_record_checksum(void) {
+    static SystemState state;
+    state.cpu_slots = 2;
+    state.cpu_usage_percent[0] = 12.5;
+    state.mem_total_kb = 1000;
+
+    uint32_t record_size = sysmon_record_size(2);
+    SysmonRecord *record = calloc(1, record_size);
+    fill_binary_record(&state, 2, record_size, record);
+    CHECK(sysmon_record_valid(record, record_size));
+    CHECK(record->length == record_size);
+
+    // A flipped bit, or a record of another size, does not pass
+    ((unsigned char *)record)[record_size - 1] ^= 0x10;
+    CHECK(!sysmon_record_valid(record, record_size));
+    ((unsigned char *)record)[record_size - 1] ^= 0x10;
+    CHECK(!sysmon_record_valid(record, sysmon_record_size(1)));
+    free(record);
+}
+
+/* --- Command line --- */
+
+static int parse(Config *config, char *a, char *b, char *c) {
+    char *argv[] = { "sm", a, b, c, NULL };
+    int argc = 1;
+    while (argv[argc]) argc++;
+    return parse_args(argc, argv, config);
+}
+
+static void test_parse_args_long_only_options(void) {
+    Config config;
+    CHECK(parse(&config, "--flush-sec", "5", NULL) == 0 && config.flush_sec == 5 && config.publish_shm);
+    CHECK(parse(&config, "--flush-sec=7", "--fsync", "data") == 0 && config.flush_sec == 7 &&
+          config.fsync == FSYNC_DATA);
+    CHECK(parse(&config, "--fsync=full", NULL, NULL) == 0 && config.fsync == FSYNC_FULL);
+    CHECK(parse(&config, "-b", "4", NULL) == 0 && config.batch_samples == 4);
+
+    CHECK(parse(&config, "--flush-sec", NULL, NULL) != 0);
+    CHECK(parse(&config, "--fsync", "sometimes", NULL) != 0);
+    CHECK(parse(&config, "-x", "1", NULL) != 0);
+}
+
+/* --- Output sink --- */
+
+#define SINK_PREFIX 1000 // Bytes of the log before the sink starts: not a page boundary
+
+/**
+ * Fills buf with the i-th test sample, a line of len bytes.
+ */
+static void make_sample(int i, char *buf, size_t len) {
+    memset(buf, 'a' + i % 26, len);
+    snprintf(buf, len, "%06d", i);
+    buf[6] = ' ';
+    buf[len - 1] = '\n';
+}
+
+static void test_sink_carries_partial_page(void) {
+    static const Config config = { .batch_samples = 4 };
+    static char sample[1000], expected[8192], got[8192];
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, SINK_PREFIX);
+    OutputSink sink;
+    sink_init(&sink, &config);
+    memset(expected, '#', SINK_PREFIX);
+
+    for (int i = 0; i < 4; i++) {
+        make_sample(i, sample, sizeof(sample));
+        memcpy(expected + SINK_PREFIX + i * sizeof(sample), sample, sizeof(sample));
+        sink_append(&sink, sample, sizeof(sample));
+        if (i < 3) CHECK(file_size(tmp) == SINK_PREFIX);
+    }
+    // The batch is written up to the page boundary; the partial page waits
+    CHECK(file_size(tmp) == sink.page_size);
+    CHECK(sink.len == SINK_PREFIX + 4 * sizeof(sample) - (size_t)sink.page_size);
+
+    sink_flush(&sink, 1);
+    restore_stdout(saved);
+    CHECK(sink.len == 0);
+    CHECK(read_back(tmp, got, sizeof(got)) == SINK_PREFIX + 4 * sizeof(sample));
+    CHECK(memcmp(got, expected, SINK_PREFIX + 4 * sizeof(sample)) == 0);
+    free(sink.buf);
+    fclose(tmp);
+}
+
+static void test_sink_age_limit(void) {
+    static const Config config = { .batch_samples = 1000, .flush_sec = 5 };
+    static char sample[300];
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, SINK_PREFIX);
+    OutputSink sink;
+    sink_init(&sink, &config);
+
+    make_sample(0, sample, sizeof(sample));
+    sink_append(&sink, sample, sizeof(sample));
+    CHECK(file_size(tmp) == SINK_PREFIX);
+
+    // wait_next_tick() wakes flush_sec after the oldest sample was buffered
+    struct timespec due;
+    CHECK(sink_flush_due(&sink, &due) == 1);
+    CHECK(due.tv_sec == sink.oldest.tv_sec + 5 && due.tv_nsec == sink.oldest.tv_nsec);
+
+    // The next sample after the limit takes everything out, partial page included
+    sink.oldest.tv_sec -= 5;
+    make_sample(1, sample, sizeof(sample));
+    sink_append(&sink, sample, sizeof(sample));
+    CHECK(file_size(tmp) == SINK_PREFIX + 2 * (off_t)sizeof(sample));
+    CHECK(sink.len == 0);
+    CHECK(sink_flush_due(&sink, &due) == 0);
+
+    restore_stdout(saved);
+    free(sink.buf);
+    fclose(tmp);
+}
+
+/**
+ * Regression: --batch 1 --flush-sec N held the part of each sample past a
+ * page boundary back until the time limit.
+ */
+static void test_sink_batch_one_with_age_limit(void) {
+    static const Config config = { .batch_samples = 1, .flush_sec = 60 };
+    static char sample[1500];
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, SINK_PREFIX);
+    OutputSink sink;
+    sink_init(&sink, &config);
+
+    for (int i = 0; i < 8; i++) {
+        make_sample(i, sample, sizeof(sample));
+        sink_append(&sink, sample, sizeof(sample));
+        CHECK(sink.len == 0);
+        CHECK(file_size(tmp) == SINK_PREFIX + (i + 1) * (off_t)sizeof(sample));
+    }
+
+    restore_stdout(saved);
+    free(sink.buf);
+    fclose(tmp);
+}
+
+/**
+ * Writes the same samples through a sink with the given settings.
+ * @return Length of the resulting file, read back into out.
+ */
+static size_t sink_output(const Config *config, int age_every, char *out, size_t size) {
+    static char sample[SINK_BUFFER_SIZE + 4096];
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, SINK_PREFIX);
+    OutputSink sink;
+    sink_init(&sink, config);
+
+    unsigned seed = 1;
+    for (int i = 0; i < 400; i++) {
+        seed = seed * 1103515245 + 12345;
+        // Mostly sample-sized, now and then larger than the whole buffer
+        size_t len = (i % 97 == 50) ? sizeof(sample) : 64 + (seed >> 16) % 3000;
+        make_sample(i, sample, len);
+        if (age_every && i % age_every == 0) sink.oldest.tv_sec -= config->flush_sec;
+        sink_append(&sink, sample, len);
+    }
+    sink_flush(&sink, 1);
+
+    restore_stdout(saved);
+    size_t len = read_back(tmp, out, size);
+    free(sink.buf);
+    fclose(tmp);
+    return len;
+}
+
+static void test_sink_output_matches_unbuffered(void) {
+    static char unbuffered[4 << 20], batched[4 << 20];
+    static const Config plain = { .batch_samples = 1 };
+    size_t len = sink_output(&plain, 0, unbuffered, sizeof(unbuffered));
+    CHECK(len > SINK_BUFFER_SIZE);
+
+    const Config configs[] = { { .batch_samples = 7 }, { .batch_samples = 1000 },
+                               { .batch_samples = 50, .flush_sec = 1 }, { .batch_samples = 1, .flush_sec = 3 } };
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        size_t got = sink_output(&configs[c], configs[c].flush_sec ? 13 : 0, batched, sizeof(batched));
+        CHECK(got == len && memcmp(batched, unbuffered, len) == 0);
+    }
+}
+
+/**
+ * A stop signal ends sysmon with everything buffered written out: with
+ * --batch 1000 nothing would reach the log before it.
+ */
+static void test_stop_signal_flushes(void) {
+    static char log[1 << 20];
+    FILE *tmp;
+    int saved = stdout_to_tmpfile(&tmp, 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        char *argv[] = { "sm", "--interval", "10", "--batch", "1000", NULL };
+        _exit(sysmon_main(5, argv)); // _exit: the leak checker has no business in the child
+    }
+    restore_stdout(saved);
+
+    struct timespec pause = { 0, 300 * NSEC_PER_MSEC };
+    nanosleep(&pause, NULL);
+    CHECK(file_size(tmp) == 0);
+    kill(pid, SIGTERM);
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    size_t len = read_back(tmp, log, sizeof(log));
+    CHECK(len > 0 && log[len - 1] == '\n');
+    int lines = 0;
+    for (char *line = log, *eol; line < log + len; line = eol + 1) {
+        eol = memchr(line, '\n', (size_t)(log + len - line));
+        size_t start;
+        CHECK(sysmon_json_verify(line, (size_t)(eol - line), &start) == 1 && start == 0);
+        lines++;
+    }
+    CHECK(lines >= 5);
+    fclose(tmp);
+}
+
+int main(void) {
+    sysmon_crc32c_init();
+    test_cpu_usage_counter_going_backwards();
+    test_cpu_usage_idle_interval();
+    test_cpu_usage_matches_per_slot_sums();
+    test_meminfo_fields();
+    test_meminfo_stops_once_all_found();
+    test_meminfo_absent_keys();
+    test_crc32c();
+    test_json_record_checksum();
+    test_binary_record_checksum();
+    test_parse_args_long_only_options();
+    test_sink_carries_partial_page();
+    test_sink_age_limit();
+    test_sink_batch_one_with_age_limit();
+    test_sink_output_matches_unbuffered();
+    test_stop_signal_flushes();
+
+    if (failures) {
+        fprintf(stderr, "test_sysmon: %d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("test_sysmon: ok\n");
+    return EXIT_SUCCESS;
+}